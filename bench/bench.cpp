@@ -0,0 +1,374 @@
+#include "bs.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <optional>
+
+#include <ctime>
+#include <cxxopts.hpp>
+#include <unistd.h>
+
+
+struct BenchEngine
+{
+    std::string    name;
+    bs::SortConfig config;
+};
+
+struct BenchDevice
+{
+    std::string select;
+    cl::Device  device;
+};
+
+// One cell of the sweep: either timings or the reason it was not measured
+struct BenchResult
+{
+    std::string select;
+    std::string device;
+    std::string engine;
+    std::string distribution;
+    size_t      n = 0;
+    bs::Timings timings;
+    bs::Timings build;
+    std::optional<std::string> skipped;
+};
+
+// Device time of the sorts and host time of their program builds
+struct SortTimings
+{
+    bs::Timings device;
+    bs::Timings build;
+};
+
+BenchEngine parseBenchEngine(const std::string& name);
+std::vector<BenchDevice> benchDevices(const bs::IDeviceSearcher& searcher, const std::vector<std::string>& selected);
+std::optional<std::string> skipReason(const BenchEngine& engine, const cl::Device& device, size_t n);
+SortTimings timeSort(const std::vector<int>& input, const cl::Device& device, const std::string& kernelSource,
+                     const bs::SortConfig& config, size_t warmup, size_t repeat);
+void printResult(const BenchResult& result);
+void writeJson(const std::string& fileName, const std::vector<BenchResult>& results, size_t warmup, size_t repeat,
+               uint64_t seed);
+
+// Keys cross the bus twice per sort: uploaded once and read back once
+constexpr double bytesPerKey = 2 * sizeof(int);
+
+int main(int argc, const char* argv[]) try
+{
+    cxxopts::Options options("bench", "Benchmark suite of the OpenCL sorts");
+    options.add_options()
+        ("min-log", "Smallest size as a power of two", cxxopts::value<size_t>()->default_value("10"))
+        ("max-log", "Largest size as a power of two", cxxopts::value<size_t>()->default_value("30"))
+        ("step", "Power of two step between sizes", cxxopts::value<size_t>()->default_value("1"))
+        ("d,dist", "Input distributions (uniform, sorted, reverse, nearly-sorted, few-unique, zipf, all-equal, "
+                   "organ-pipe, staggered)",
+            cxxopts::value<std::vector<std::string>>()->default_value("uniform,sorted,reverse,nearly-sorted,few-unique"))
+        ("e,engine", "Engines (bitonic, oddeven, transposed, radix)",
+            cxxopts::value<std::vector<std::string>>()->default_value("bitonic,oddeven,transposed,radix"))
+        ("s,select", "Devices as <platformIdx>:<deviceIdx> (default: every device)",
+            cxxopts::value<std::vector<std::string>>())
+        ("w,warmup", "Untimed runs before the timed ones", cxxopts::value<size_t>()->default_value("1"))
+        ("r,repeat", "Timed runs of every cell", cxxopts::value<size_t>()->default_value("5"))
+        ("seed", "Seed of the generated inputs", cxxopts::value<uint64_t>()->default_value("1"))
+        ("j,json", "Write the results to this JSON file", cxxopts::value<std::string>()->default_value("bench.json"))
+        ("h,help", "Print usage");
+
+    auto result = options.parse(argc, argv);
+    if (result.count("help"))
+    {
+        std::cout << options.help() << std::endl;
+        exit(0);
+    }
+
+    size_t minLog = result["min-log"].as<size_t>();
+    size_t maxLog = result["max-log"].as<size_t>();
+    size_t step = result["step"].as<size_t>();
+    size_t warmup = result["warmup"].as<size_t>();
+    size_t repeat = result["repeat"].as<size_t>();
+    uint64_t seed = result["seed"].as<uint64_t>();
+
+    if (minLog > maxLog || maxLog > 40 || step == 0)
+        throw std::invalid_argument("Expected --min-log <= --max-log <= 40 and --step > 0");
+
+    if (repeat == 0)
+        throw std::invalid_argument("--repeat must be positive");
+
+    std::vector<bs::Distribution> distributions;
+
+    for (const auto& name : result["dist"].as<std::vector<std::string>>())
+        distributions.push_back(bs::parseDistribution(name));
+
+    std::vector<BenchEngine> engines;
+
+    for (const auto& name : result["engine"].as<std::vector<std::string>>())
+        engines.push_back(parseBenchEngine(name));
+
+    auto searcher = bs::createDeviceSearcher();
+    std::vector<std::string> selected;
+
+    if (result.count("select"))
+        selected = result["select"].as<std::vector<std::string>>();
+
+    std::vector<BenchDevice> devices = benchDevices(*searcher, selected);
+
+    std::string kernelSource = bs::readKernel("src/bitonicSort_gkernel.cl")  +
+                               bs::readKernel("src/bitonicSort_lkernel.cl")  +
+                               bs::readKernel("src/bitonicSort_ckernel.cl")  +
+                               bs::readKernel("src/oddEvenMerge_gkernel.cl") +
+                               bs::readKernel("src/oddEvenMerge_lkernel.cl") +
+                               bs::readKernel("src/radixBucket_kernel.cl")   +
+                               bs::readKernel("src/bitonicTranspose_kernel.cl");
+
+    // Input and output of the largest cell have to fit into physical memory
+    size_t hostBytes = static_cast<size_t>(::sysconf(_SC_PHYS_PAGES)) * ::sysconf(_SC_PAGESIZE);
+
+    std::vector<BenchResult> results;
+
+    for (bs::Distribution distribution : distributions)
+    {
+        for (size_t log = minLog; log <= maxLog; log += step)
+        {
+            size_t n = size_t(1) << log;
+            bool fitsHost = 2 * sizeof(int) * n <= hostBytes;
+
+            std::vector<int> input;
+
+            if (fitsHost)
+                input = bs::generateKeys(distribution, n, seed);
+
+            for (const auto& device : devices)
+            {
+                for (const auto& engine : engines)
+                {
+                    BenchResult cell;
+                    cell.select = device.select;
+                    cell.device = device.device.getInfo<CL_DEVICE_NAME>();
+                    cell.engine = engine.name;
+                    cell.distribution = bs::distributionName(distribution);
+                    cell.n = n;
+
+                    cell.skipped = fitsHost ? skipReason(engine, device.device, n) : "input does not fit into host memory";
+
+                    if (!cell.skipped)
+                    {
+                        try
+                        {
+                            auto [timings, build] = timeSort(input, device.device, kernelSource, engine.config, warmup,
+                                                             repeat);
+
+                            cell.timings = std::move(timings);
+                            cell.build = std::move(build);
+                        }
+                        catch (const std::exception& e)
+                        {
+                            cell.skipped = e.what();
+                        }
+                    }
+
+                    printResult(cell);
+                    results.push_back(std::move(cell));
+                }
+            }
+        }
+    }
+
+    writeJson(result["json"].as<std::string>(), results, warmup, repeat, seed);
+}
+catch (const std::exception& e)
+{
+    std::cout << "Error: " << e.what() << std::endl;
+    return 1;
+}
+
+BenchEngine parseBenchEngine(const std::string& name)
+{
+    if (name == "bitonic")
+        return {name, {bs::Engine::Network, bs::Network::Bitonic, false}};
+
+    if (name == "oddeven")
+        return {name, {bs::Engine::Network, bs::Network::OddEvenMerge, false}};
+
+    if (name == "transposed")
+        return {name, {bs::Engine::Network, bs::Network::Bitonic, true}};
+
+    if (name == "radix")
+        return {name, {bs::Engine::RadixBucket, bs::Network::Bitonic, false}};
+
+    throw std::invalid_argument("Unknown engine: " + name + ". Expected bitonic, oddeven, transposed or radix");
+}
+
+std::vector<BenchDevice> benchDevices(const bs::IDeviceSearcher& searcher, const std::vector<std::string>& selected)
+{
+    std::vector<BenchDevice> devices;
+
+    if (selected.empty())
+    {
+        for (size_t platformIdx = 0; platformIdx < searcher.getPlatformsCount(); ++platformIdx)
+        {
+            for (size_t deviceIdx = 0; deviceIdx < searcher.getDevicesCount(platformIdx); ++deviceIdx)
+                devices.push_back({std::to_string(platformIdx) + ":" + std::to_string(deviceIdx),
+                                   searcher.getDevice(platformIdx, deviceIdx)});
+        }
+
+        return devices;
+    }
+
+    for (const auto& select : selected)
+    {
+        auto colonPos = select.find(':');
+
+        if (colonPos == std::string::npos)
+            throw std::runtime_error("Invalid format for --select. Expected <platformIdx>:<deviceIdx>");
+
+        size_t platformIdx = std::stoul(select.substr(0, colonPos));
+        size_t deviceIdx = std::stoul(select.substr(colonPos + 1));
+
+        devices.push_back({select, searcher.getDevice(platformIdx, deviceIdx)});
+    }
+
+    return devices;
+}
+
+// Cells the engine cannot run are reported instead of failing the sweep
+std::optional<std::string> skipReason(const BenchEngine& engine, const cl::Device& device, size_t n)
+{
+    if (engine.config.transposed && bs::isCpuDevice(device))
+        return "transposed layout does not apply on CPU devices";
+
+    if (sizeof(int) * n > device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>())
+        return "keys exceed the device allocation limit";
+
+    return std::nullopt;
+}
+
+// Every sort runs with a profile: its device time spans the upload, the
+// kernels and the readback as the profiling events report them, context
+// creation and the program build are left out. Builds are timed apart on
+// the host. The first result is checked.
+SortTimings timeSort(const std::vector<int>& input, const cl::Device& device, const std::string& kernelSource,
+                     const bs::SortConfig& config, size_t warmup, size_t repeat)
+{
+    std::vector<int> output(input.size());
+    std::vector<double> samples;
+    std::vector<double> builds;
+    samples.reserve(repeat);
+    builds.reserve(repeat);
+
+    for (size_t run = 0; run < warmup + repeat; ++run)
+    {
+        bs::Profile profile;
+        bs::SortConfig profiled = config;
+        profiled.profile = &profile;
+
+        bs::sort(input.data(), output.data(), input.size(), device, kernelSource, profiled);
+
+        if (run == 0 && !std::is_sorted(output.begin(), output.end()))
+            throw std::runtime_error("Output is not sorted");
+
+        if (run < warmup)
+            continue;
+
+        double build = 0;
+
+        for (const auto& record : profile.records())
+        {
+            if (record.kind == bs::ProfileKind::Build)
+                build += bs::Profile::seconds(record);
+        }
+
+        samples.push_back(profile.deviceSpan());
+        builds.push_back(build);
+    }
+
+    return {bs::summarize(std::move(samples)), bs::summarize(std::move(builds))};
+}
+
+void printResult(const BenchResult& result)
+{
+    std::cout << std::left << std::setw(5) << result.select << ' ' << std::setw(11) << result.engine << ' '
+              << std::setw(14) << result.distribution << " 2^" << std::setw(3) << std::countr_zero(result.n) << std::right;
+
+    if (result.skipped)
+    {
+        std::cout << " skipped: " << *result.skipped << '\n';
+        return;
+    }
+
+    const bs::Timings& timings = result.timings;
+
+    std::cout << std::fixed << std::setprecision(6)
+              << " median " << timings.median << " s [" << timings.p10 << ", " << timings.p90 << "]"
+              << std::setprecision(2)
+              << "  " << result.n / timings.median / 1e6 << " Mkeys/s  "
+              << bytesPerKey * result.n / timings.median / 1e9 << " GB/s"
+              << std::setprecision(6)
+              << "  build " << result.build.median << " s\n"
+              << std::defaultfloat;
+}
+
+// One result object per line, so the file diffs well between runs
+void writeJson(const std::string& fileName, const std::vector<BenchResult>& results, size_t warmup, size_t repeat,
+               uint64_t seed)
+{
+    std::ofstream out(fileName);
+
+    if (!out)
+        throw std::runtime_error("Failed to create file: " + fileName);
+
+    std::time_t now = std::time(nullptr);
+    char timestamp[32];
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    out << std::setprecision(9);
+    out << "{\n"
+        << "  \"timestamp\": " << bs::jsonString(timestamp) << ",\n"
+        << "  \"warmup\": " << warmup << ",\n"
+        << "  \"repeat\": " << repeat << ",\n"
+        << "  \"seed\": " << seed << ",\n"
+        << "  \"results\": [\n";
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult& result = results[i];
+
+        out << "    {\"select\": " << bs::jsonString(result.select)
+            << ", \"device\": " << bs::jsonString(result.device)
+            << ", \"engine\": " << bs::jsonString(result.engine)
+            << ", \"distribution\": " << bs::jsonString(result.distribution)
+            << ", \"n\": " << result.n;
+
+        if (result.skipped)
+        {
+            out << ", \"skipped\": " << bs::jsonString(*result.skipped);
+        }
+        else
+        {
+            const bs::Timings& timings = result.timings;
+
+            out << ", \"median_s\": " << timings.median
+                << ", \"p10_s\": " << timings.p10
+                << ", \"p90_s\": " << timings.p90
+                << ", \"stddev_s\": " << timings.stddev
+                << ", \"keys_per_s\": " << result.n / timings.median
+                << ", \"gb_per_s\": " << bytesPerKey * result.n / timings.median / 1e9
+                << ", \"build_s\": " << result.build.median
+                << ", \"samples_s\": [";
+
+            for (size_t j = 0; j < timings.samples.size(); ++j)
+                out << (j ? ", " : "") << timings.samples[j];
+
+            out << "]";
+        }
+
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    out << "  ]\n}\n";
+
+    if (!out)
+        throw std::runtime_error("Failed to write file: " + fileName);
+}
@@ -0,0 +1,257 @@
+#include "stats.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <optional>
+#include <map>
+#include <tuple>
+
+#include <cxxopts.hpp>
+
+
+// Measured cell of a bench results file, skipped cells are not read
+struct BenchCell
+{
+    std::string select;
+    std::string device;
+    std::string engine;
+    std::string distribution;
+    size_t      n = 0;
+    double      median = 0;
+    std::vector<double> samples;
+
+    auto key() const { return std::tie(select, device, engine, distribution, n); }
+};
+
+enum class Verdict
+{
+    Unchanged,
+    Noisy,      // median moved past the threshold, but the samples overlap too much to tell
+    Regressed,
+    Improved
+};
+
+std::vector<BenchCell> readBenchResults(const std::string& fileName);
+Verdict judge(const BenchCell& baseline, const BenchCell& current, double threshold, double alpha, double& p);
+
+int main(int argc, const char* argv[]) try
+{
+    cxxopts::Options options("bench_compare", "Flags benchmark cells that got slower than in a baseline run");
+    options.add_options()
+        ("baseline", "Bench JSON of the baseline run", cxxopts::value<std::string>())
+        ("current", "Bench JSON of the run to check", cxxopts::value<std::string>())
+        ("t,threshold", "Slowdown of the median that counts as a regression (0.05 is 5%)",
+            cxxopts::value<double>()->default_value("0.05"))
+        ("alpha", "Significance level of the Mann-Whitney test on the samples",
+            cxxopts::value<double>()->default_value("0.05"))
+        ("h,help", "Print usage");
+
+    options.parse_positional({"baseline", "current"});
+
+    auto result = options.parse(argc, argv);
+    if (result.count("help") || !result.count("baseline") || !result.count("current"))
+    {
+        std::cout << options.help() << std::endl;
+        exit(result.count("help") ? 0 : 2);
+    }
+
+    double threshold = result["threshold"].as<double>();
+    double alpha = result["alpha"].as<double>();
+
+    std::vector<BenchCell> baseline = readBenchResults(result["baseline"].as<std::string>());
+    std::vector<BenchCell> current = readBenchResults(result["current"].as<std::string>());
+
+    std::map<decltype(baseline[0].key()), const BenchCell*> baselineCells;
+
+    for (const auto& cell : baseline)
+        baselineCells[cell.key()] = &cell;
+
+    size_t compared = 0;
+    size_t regressed = 0;
+    size_t improved = 0;
+    size_t unmatched = 0;
+
+    for (const auto& cell : current)
+    {
+        auto it = baselineCells.find(cell.key());
+
+        if (it == baselineCells.end())
+        {
+            ++unmatched;
+            continue;
+        }
+
+        const BenchCell& base = *it->second;
+        double p = 1;
+        Verdict verdict = judge(base, cell, threshold, alpha, p);
+
+        ++compared;
+        regressed += verdict == Verdict::Regressed;
+        improved += verdict == Verdict::Improved;
+
+        if (verdict == Verdict::Unchanged)
+            continue;
+
+        const char* label = verdict == Verdict::Regressed ? "REGRESSED" : verdict == Verdict::Improved ? "improved" : "noisy";
+
+        std::cout << std::left << std::setw(10) << label << std::setw(5) << cell.select << ' ' << std::setw(11)
+                  << cell.engine << ' ' << std::setw(14) << cell.distribution << " n " << std::setw(11) << cell.n
+                  << std::right << std::fixed << std::setprecision(6) << base.median << " s -> " << cell.median << " s"
+                  << std::setprecision(1) << " (" << std::showpos << 100 * (cell.median / base.median - 1)
+                  << std::noshowpos << "%, p " << std::setprecision(3) << p << ")\n" << std::defaultfloat;
+    }
+
+    std::cout << compared << " cells compared: " << regressed << " regressed, " << improved << " improved";
+
+    if (unmatched > 0)
+        std::cout << ", " << unmatched << " not in the baseline";
+
+    std::cout << '\n';
+
+    return regressed > 0 ? 1 : 0;
+}
+catch (const std::exception& e)
+{
+    std::cout << "Error: " << e.what() << std::endl;
+    return 2;
+}
+
+// A cell regressed when its median is more than threshold slower and the
+// samples are slower with significance alpha, so one slow run of a noisy
+// cell is not flagged. Too few samples never reach a small alpha: with 5
+// and 5 the smallest p is 1/252.
+Verdict judge(const BenchCell& baseline, const BenchCell& current, double threshold, double alpha, double& p)
+{
+    double ratio = current.median / baseline.median;
+
+    if (ratio > 1 + threshold)
+    {
+        p = bs::mannWhitneyGreater(current.samples, baseline.samples);
+        return p < alpha ? Verdict::Regressed : Verdict::Noisy;
+    }
+
+    if (ratio < 1 - threshold)
+    {
+        p = bs::mannWhitneyGreater(baseline.samples, current.samples);
+        return p < alpha ? Verdict::Improved : Verdict::Noisy;
+    }
+
+    return Verdict::Unchanged;
+}
+
+// Value of "name": "..." in a line of the bench JSON, with the escapes
+// bs::jsonString writes
+std::optional<std::string> stringField(std::string_view line, std::string_view name)
+{
+    std::string pattern = "\"" + std::string(name) + "\": \"";
+    size_t pos = line.find(pattern);
+
+    if (pos == std::string_view::npos)
+        return std::nullopt;
+
+    std::string value;
+
+    for (pos += pattern.size(); pos < line.size() && line[pos] != '"'; ++pos)
+    {
+        if (line[pos] != '\\' || pos + 1 >= line.size())
+        {
+            value += line[pos];
+            continue;
+        }
+
+        ++pos;
+
+        if (line[pos] == 'u' && pos + 4 < line.size())
+        {
+            value += static_cast<char>(std::stoi(std::string(line.substr(pos + 1, 4)), nullptr, 16));
+            pos += 4;
+        }
+        else
+        {
+            value += line[pos];
+        }
+    }
+
+    return value;
+}
+
+std::optional<double> numberField(std::string_view line, std::string_view name)
+{
+    std::string pattern = "\"" + std::string(name) + "\": ";
+    size_t pos = line.find(pattern);
+
+    if (pos == std::string_view::npos)
+        return std::nullopt;
+
+    return std::stod(std::string(line.substr(pos + pattern.size(), 32)));
+}
+
+std::vector<double> arrayField(std::string_view line, std::string_view name)
+{
+    std::string pattern = "\"" + std::string(name) + "\": [";
+    size_t pos = line.find(pattern);
+    std::vector<double> values;
+
+    if (pos == std::string_view::npos)
+        return values;
+
+    std::string list(line.substr(pos + pattern.size(), line.find(']', pos) - pos - pattern.size()));
+    const char* cursor = list.c_str();
+    char* end = nullptr;
+
+    for (double value = std::strtod(cursor, &end); end != cursor; value = std::strtod(cursor, &end))
+    {
+        values.push_back(value);
+        cursor = end;
+
+        while (*cursor == ',' || *cursor == ' ')
+            ++cursor;
+    }
+
+    return values;
+}
+
+// The bench writes one result object per line, measured cells are the ones
+// with samples
+std::vector<BenchCell> readBenchResults(const std::string& fileName)
+{
+    std::ifstream in(fileName);
+
+    if (!in)
+        throw std::runtime_error("Failed to open file: " + fileName);
+
+    std::vector<BenchCell> cells;
+    std::string line;
+
+    while (std::getline(in, line))
+    {
+        std::optional<std::string> select = stringField(line, "select");
+
+        if (!select || !numberField(line, "median_s"))
+            continue;
+
+        BenchCell cell;
+        cell.select = *select;
+        cell.device = stringField(line, "device").value_or("");
+        cell.engine = stringField(line, "engine").value_or("");
+        cell.distribution = stringField(line, "distribution").value_or("");
+        cell.n = static_cast<size_t>(numberField(line, "n").value_or(0));
+        cell.median = *numberField(line, "median_s");
+        cell.samples = arrayField(line, "samples_s");
+
+        if (cell.samples.empty())
+            cell.samples.push_back(cell.median);
+
+        cells.push_back(std::move(cell));
+    }
+
+    if (cells.empty())
+        throw std::runtime_error("No measured cells in " + fileName);
+
+    return cells;
+}
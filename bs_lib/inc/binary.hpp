@@ -0,0 +1,359 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "parser.hpp"
+#include "writer.hpp"
+
+namespace bs {
+
+// Binary key file: a 32 byte header followed by count raw keys. All fields
+// and the payload are little-endian, the payload starts right after the
+// header so it is aligned for any key type.
+static_assert(std::endian::native == std::endian::little,
+              "Binary key files are read and written in place on little-endian hosts only");
+
+enum class KeyType : uint8_t
+{
+    Int32 = 1
+};
+
+template <typename T>
+constexpr KeyType keyTypeOf()
+{
+    static_assert(std::is_same_v<T, int32_t>, "Binary key files hold 32-bit signed keys only");
+    return KeyType::Int32;
+}
+
+constexpr char     binaryMagic[4]    = {'B', 'S', 'R', 'T'};
+constexpr uint16_t binaryVersion     = 1;
+constexpr uint8_t  binarySortedFlag  = 1;
+
+struct BinaryHeader
+{
+    char     magic[4];
+    uint16_t version;
+    uint8_t  keyType;
+    uint8_t  flags;
+    uint64_t count;
+    uint64_t checksum;
+    uint64_t reserved;
+};
+
+static_assert(sizeof(BinaryHeader) == 32);
+
+// FNV-1a over 64-bit words of the payload, a trailing partial word is zero
+// padded. Word-wise instead of byte-wise to keep up with mmap throughput.
+// Fed incrementally by the writers that stream the payload out in blocks.
+class PayloadChecksum
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    uint64_t partial = 0;
+    size_t   partialBytes = 0;
+
+    void mix(uint64_t word)
+    {
+        hash = (hash ^ word) * 0x100000001b3ull;
+    }
+
+public:
+    void update(const char* data, size_t size)
+    {
+        while (partialBytes > 0 && size > 0)
+        {
+            partial |= static_cast<uint64_t>(static_cast<uint8_t>(*data++)) << (8 * partialBytes);
+            --size;
+
+            if (++partialBytes == sizeof(uint64_t))
+            {
+                mix(partial);
+                partial = 0;
+                partialBytes = 0;
+            }
+        }
+
+        size_t words = size / sizeof(uint64_t);
+
+        for (size_t i = 0; i < words; ++i)
+        {
+            uint64_t word;
+            std::memcpy(&word, data + i * sizeof(uint64_t), sizeof(word));
+
+            mix(word);
+        }
+
+        for (size_t i = words * sizeof(uint64_t); i < size; ++i)
+            partial |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (8 * partialBytes++);
+    }
+
+    uint64_t value() const
+    {
+        if (partialBytes == 0)
+            return hash;
+
+        return (hash ^ partial) * 0x100000001b3ull;
+    }
+};
+
+uint64_t payloadChecksum(const char* data, size_t size)
+{
+    PayloadChecksum checksum;
+    checksum.update(data, size);
+
+    return checksum.value();
+}
+
+// Only regular files are probed: reading the magic from a pipe or FIFO
+// would consume the input (and a FIFO blocks on open until a writer comes),
+// anything else is text
+bool isBinaryFile(std::string_view fileName)
+{
+    struct stat st;
+
+    if (::stat(std::string(fileName).c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+
+    int fd = ::open(std::string(fileName).c_str(), O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    char magic[sizeof(binaryMagic)];
+    bool matches = ::read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+                   std::memcmp(magic, binaryMagic, sizeof(magic)) == 0;
+
+    ::close(fd);
+
+    return matches;
+}
+
+BinaryHeader makeBinaryHeader(KeyType keyType, size_t count, bool sorted, uint64_t checksum)
+{
+    BinaryHeader header{};
+
+    std::memcpy(header.magic, binaryMagic, sizeof(binaryMagic));
+    header.version  = binaryVersion;
+    header.keyType  = static_cast<uint8_t>(keyType);
+    header.flags    = sorted ? binarySortedFlag : 0;
+    header.count    = count;
+    header.checksum = checksum;
+
+    return header;
+}
+
+// Memory-mapped binary key file. The keys are used straight from the mapping,
+// nothing is copied on open. A writable reader lets the keys be sorted in
+// the file itself, markSorted() then restamps the header.
+class BinaryReader
+{
+    MappedFile   file;
+    BinaryHeader header;
+    bool         writable;
+
+public:
+    explicit BinaryReader(std::string_view fileName, bool verifyChecksum = true, bool writable = false)
+        : file(fileName, writable), writable(writable)
+    {
+        if (file.size() < sizeof(BinaryHeader))
+            throw std::runtime_error("Binary file is too short for a header: " + std::string(fileName));
+
+        std::memcpy(&header, file.data(), sizeof(BinaryHeader));
+
+        if (std::memcmp(header.magic, binaryMagic, sizeof(binaryMagic)) != 0)
+            throw std::runtime_error("Not a binary key file: " + std::string(fileName));
+
+        if (header.version != binaryVersion)
+            throw std::runtime_error("Unsupported binary file version: " + std::to_string(header.version));
+
+        if (header.keyType != static_cast<uint8_t>(KeyType::Int32))
+            throw std::runtime_error("Unsupported key type in binary file: " + std::to_string(header.keyType));
+
+        size_t payloadSize = file.size() - sizeof(BinaryHeader);
+
+        if (payloadSize % sizeof(int32_t) != 0 || payloadSize / sizeof(int32_t) != header.count)
+            throw std::runtime_error("Binary file size does not match its header. Expected: " +
+                                     std::to_string(header.count) + " keys");
+
+        if (verifyChecksum && payloadChecksum(file.data() + sizeof(BinaryHeader), payloadSize) != header.checksum)
+            throw std::runtime_error("Binary file checksum mismatch: " + std::string(fileName));
+    }
+
+    size_t count() const { return header.count; }
+    bool sorted() const { return header.flags & binarySortedFlag; }
+
+    template <typename T>
+    const T* keys() const
+    {
+        if (keyTypeOf<T>() != static_cast<KeyType>(header.keyType))
+            throw std::runtime_error("Binary file holds a different key type");
+
+        return reinterpret_cast<const T*>(file.data() + sizeof(BinaryHeader));
+    }
+
+    template <typename T>
+    T* mutableKeys()
+    {
+        if (!writable)
+            throw std::logic_error("Binary file is mapped read-only");
+
+        return const_cast<T*>(keys<T>());
+    }
+
+    void markSorted()
+    {
+        if (!writable)
+            throw std::logic_error("Binary file is mapped read-only");
+
+        uint64_t checksum = payloadChecksum(file.data() + sizeof(BinaryHeader), file.size() - sizeof(BinaryHeader));
+
+        header = makeBinaryHeader(static_cast<KeyType>(header.keyType), header.count, true, checksum);
+
+        std::memcpy(file.data(), &header, sizeof(BinaryHeader));
+    }
+};
+
+// Creates a binary key file of count keys and maps it for writing, keys() is
+// filled by the caller (e.g. read back from the device straight into it) and
+// finish() stamps the header with the checksum.
+template <typename T>
+class BinaryWriter
+{
+    std::optional<MappedFile> file;
+    size_t count_;
+
+public:
+    BinaryWriter(std::string_view fileName, size_t count)
+        : count_(count)
+    {
+        int fd = ::open(std::string(fileName).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+        if (fd < 0)
+            throw std::runtime_error("Failed to create file: " + std::string(fileName));
+
+        bool resized = ::ftruncate(fd, sizeof(BinaryHeader) + sizeof(T) * count) == 0;
+
+        ::close(fd);
+
+        if (!resized)
+            throw std::runtime_error("Failed to resize file: " + std::string(fileName));
+
+        file.emplace(fileName, true);
+    }
+
+    T* keys() { return reinterpret_cast<T*>(file->data() + sizeof(BinaryHeader)); }
+    size_t count() const { return count_; }
+
+    void finish(bool sorted)
+    {
+        uint64_t checksum = payloadChecksum(file->data() + sizeof(BinaryHeader), sizeof(T) * count_);
+
+        BinaryHeader header = makeBinaryHeader(keyTypeOf<T>(), count_, sorted, checksum);
+
+        std::memcpy(file->data(), &header, sizeof(BinaryHeader));
+    }
+};
+
+// Writes a binary key file front to back through a buffer, for outputs that
+// are produced block by block and may not fit in memory (merged runs). The
+// header goes in last, once the count and the checksum are known.
+template <typename T>
+class BinaryStreamWriter
+{
+    int             fd;
+    std::vector<T>  buffer;
+    size_t          buffered = 0;
+    size_t          count_ = 0;
+    PayloadChecksum checksum;
+    std::string     fileName;
+
+    void flush()
+    {
+        checksum.update(reinterpret_cast<const char*>(buffer.data()), sizeof(T) * buffered);
+
+        std::vector<iovec> parts{{buffer.data(), sizeof(T) * buffered}};
+        writeAll(fd, parts);
+
+        buffered = 0;
+    }
+
+public:
+    explicit BinaryStreamWriter(std::string_view fileName, size_t bufferKeys = 1 << 18)
+        : buffer(bufferKeys), fileName(fileName)
+    {
+        fd = ::open(this->fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if (fd < 0)
+            throw std::runtime_error("Failed to create file: " + this->fileName);
+
+        if (::lseek(fd, sizeof(BinaryHeader), SEEK_SET) < 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Failed to seek in file: " + this->fileName);
+        }
+    }
+
+    BinaryStreamWriter(const BinaryStreamWriter&) = delete;
+    BinaryStreamWriter& operator=(const BinaryStreamWriter&) = delete;
+
+    ~BinaryStreamWriter()
+    {
+        ::close(fd);
+    }
+
+    void append(const T* keys, size_t n)
+    {
+        count_ += n;
+
+        while (n > 0)
+        {
+            size_t taken = std::min(n, buffer.size() - buffered);
+
+            std::copy_n(keys, taken, buffer.data() + buffered);
+
+            buffered += taken;
+            keys += taken;
+            n -= taken;
+
+            if (buffered == buffer.size())
+                flush();
+        }
+    }
+
+    size_t count() const { return count_; }
+
+    void finish(bool sorted)
+    {
+        flush();
+
+        BinaryHeader header = makeBinaryHeader(keyTypeOf<T>(), count_, sorted, checksum.value());
+
+        if (::pwrite(fd, &header, sizeof(header), 0) != sizeof(header))
+            throw std::runtime_error("Failed to write header: " + fileName);
+    }
+};
+
+template <typename T>
+void writeBinary(std::string_view fileName, const T* keys, size_t count, bool sorted)
+{
+    BinaryWriter<T> writer(fileName, count);
+
+    std::copy_n(keys, count, writer.keys());
+
+    writer.finish(sorted);
+}
+
+}; // namespace bs
@@ -7,13 +7,40 @@
 #include <optional>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
 #include <algorithm>
+#include <numeric>
+#include <execution>
+#include <bit>
+#include <limits>
+#include <type_traits>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <future>
+#include <filesystem>
+#include <map>
+#include <cstdlib>
 
 #define CL_HPP_ENABLE_EXCEPTIONS
 #define CL_HPP_TARGET_OPENCL_VERSION 120
 #define CL_HPP_MINIMUM_OPENCL_VERSION 120
 
 #include "opencl.hpp"
+#include "profile.hpp"
+#include "counters.hpp"
+#include "parser.hpp"
+#include "binary.hpp"
+#include "writer.hpp"
+#include "delta.hpp"
+#include "runs.hpp"
+#include "npy.hpp"
+#include "table.hpp"
+#include "uring.hpp"
+#include "stats.hpp"
+#include "workload.hpp"
+#include "stdsort.hpp"
 
 namespace bs {
 
@@ -298,82 +325,1634 @@ void bitonicSort(std::vector<T>& sequence, const cl::Device& device, const std::
     queue.enqueueReadBuffer(buffer, CL_TRUE, 0, sizeof(int) * sequence.size(), sequence.data());
 }
 
+enum class Network
+{
+    Bitonic,
+    OddEvenMerge
+};
+
+// Kernel pair of a sorting network and how many elements one work item owns.
+// Every network is driven by the same stage/subStage loop in networkSort():
+// stages that fit into a work group go through the local kernel, the others
+// are split into global substages.
+struct NetworkSchedule
+{
+    const char* gkernelName;
+    const char* lkernelName;
+    size_t      elementsPerItem;
+};
+
+NetworkSchedule getNetworkSchedule(Network network)
+{
+    switch (network)
+    {
+        case Network::Bitonic:
+            return {"bitonicStep_gkernel", "bitonicStep_lkernel", 1};
+        case Network::OddEvenMerge:
+            return {"oddEvenMergeStep_gkernel", "oddEvenMergeStep_lkernel", 2};
+    }
+
+    throw std::invalid_argument("Unknown sorting network");
+}
+
+Network parseNetwork(std::string_view name)
+{
+    if (name == "bitonic")
+        return Network::Bitonic;
+
+    if (name == "oddeven")
+        return Network::OddEvenMerge;
+
+    throw std::invalid_argument("Unknown sorting network: " + std::string(name) + 
+                                ". Expected bitonic or oddeven");
+}
+
+cl::Program buildProgram(const cl::Context& context, const cl::Device& device, const std::string& kernelSource,
+                         const std::string& options = "", Profile* profile = nullptr)
+{
+    cl::Program program(context, kernelSource);
+
+    HostSpan span(profile, "program build", ProfileKind::Build);
+    count(Counter::ProgramBuilds);
+
+    try
+    {
+        program.build(device, options.c_str());
+    }
+    catch (...)
+    {
+        std::string buildLog = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device);
+        std::cerr << "Build failed: " << buildLog << std::endl;
+        throw;
+    }
+
+    return program;
+}
+
+// Device buffer of the sorts, counted in the hot path counters
+cl::Buffer deviceBuffer(const cl::Context& context, cl_mem_flags flags, size_t bytes, void* hostPtr = nullptr)
+{
+    count(Counter::BufferAllocations);
+    count(Counter::BufferBytes, bytes);
+
+    return cl::Buffer(context, flags, bytes, hostPtr);
+}
+
+// Waits for the queue, counted in the hot path counters
+void finishQueue(const cl::CommandQueue& queue)
+{
+    count(Counter::QueueFinishes);
+
+    queue.finish();
+}
+
+// Device memory bandwidth in bytes per second that bandwidthCopy_kernel
+// (src/bandwidth_kernel.cl) reaches on a buffer larger than the device
+// caches: the best of a few profiled launches after a warm-up one
+double measurePeakBandwidth(const cl::Device& device, const std::string& kernelSource)
+{
+    constexpr size_t maxBytes = size_t(256) << 20;
+    constexpr int launches = 5;
+
+    size_t bytes = std::min<size_t>({maxBytes, device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>(),
+                                     device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>() / 4});
+    size_t n = bytes / sizeof(cl_int);
+
+    cl::Context context(device);
+    cl::CommandQueue queue(context, device, CL_QUEUE_PROFILING_ENABLE);
+    cl::Program program = buildProgram(context, device, kernelSource);
+
+    cl::Buffer src(context, CL_MEM_READ_ONLY, sizeof(cl_int) * n);
+    cl::Buffer dst(context, CL_MEM_WRITE_ONLY, sizeof(cl_int) * n);
+
+    queue.enqueueFillBuffer(src, cl_int(0), 0, sizeof(cl_int) * n);
+
+    cl::Kernel kernel(program, "bandwidthCopy_kernel");
+    kernel.setArg(0, src);
+    kernel.setArg(1, dst);
+
+    double best = 0;
+
+    for (int launch = 0; launch <= launches; ++launch)
+    {
+        cl::Event event;
+
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(n), cl::NullRange, nullptr, &event);
+        event.wait();
+
+        cl_ulong start = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+        cl_ulong end = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+
+        if (launch > 0 && end > start)
+            best = std::max(best, 2.0 * sizeof(cl_int) * n / ((end - start) * 1e-9));
+    }
+
+    if (best <= 0)
+        throw std::runtime_error("Failed to measure the device memory bandwidth");
+
+    return best;
+}
+
+// $XDG_CACHE_HOME/biton/bandwidth (~/.cache/biton/bandwidth), empty if
+// there is no home directory
+std::filesystem::path bandwidthCachePath()
+{
+    if (const char* cache = std::getenv("XDG_CACHE_HOME"); cache && *cache)
+        return std::filesystem::path(cache) / "biton" / "bandwidth";
+
+    if (const char* home = std::getenv("HOME"); home && *home)
+        return std::filesystem::path(home) / ".cache" / "biton" / "bandwidth";
+
+    return {};
+}
+
+// Peaks of the cache file by device key, lines of "<bytes per second>\t<device>"
+std::map<std::string, double> readBandwidthCache(const std::filesystem::path& path)
+{
+    std::map<std::string, double> peaks;
+    std::ifstream cache(path);
+    double bandwidth = 0;
+    std::string device;
+
+    while (cache >> bandwidth && cache.get() == '\t' && std::getline(cache, device))
+        peaks[device] = bandwidth;
+
+    return peaks;
+}
+
+// Exact round trip: the peak is written with all the digits a double needs
+void appendBandwidthCache(const std::filesystem::path& path, const std::string& device, double bandwidth)
+{
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+
+    std::ofstream cache(path, std::ios::app);
+    cache << std::setprecision(std::numeric_limits<double>::max_digits10) << bandwidth << '\t' << device << '\n';
+}
+
+// measurePeakBandwidth() of the device, measured once per device name and
+// driver version: the result is kept for the process and appended to the
+// cache file as "<bytes per second>\t<device>" lines for later runs. A cache
+// file that cannot be read or written only costs a new measurement.
+double peakBandwidth(const cl::Device& device, const std::string& kernelSource)
+{
+    static std::mutex mutex;
+    static std::map<std::string, double> measured;
+
+    std::string key = device.getInfo<CL_DEVICE_NAME>() + " / " + device.getInfo<CL_DRIVER_VERSION>();
+    std::filesystem::path path = bandwidthCachePath();
+
+    std::lock_guard lock(mutex);
+
+    if (measured.empty() && !path.empty())
+        measured = readBandwidthCache(path);
+
+    if (auto it = measured.find(key); it != measured.end())
+        return it->second;
+
+    double bandwidth = measurePeakBandwidth(device, kernelSource);
+    measured[key] = bandwidth;
+
+    if (!path.empty())
+        appendBandwidthCache(path, key, bandwidth);
+
+    return bandwidth;
+}
+
+// Kernels index with int (index_t in the .cl sources) as long as every index
+// fits, past INT_MAX elements the program is rebuilt with a 64-bit index_t
+// and the host passes cl_long index arguments
+bool needsWideIndex(size_t n)
+{
+    return n > static_cast<size_t>(std::numeric_limits<cl_int>::max());
+}
+
+std::string indexBuildOptions(size_t n)
+{
+    return needsWideIndex(n) ? "-D index_t=long" : "";
+}
+
+// Keys are int (key_t in the .cl sources) unless the program is built for
+// another key type. Double keys need cl_khr_fp64 on the device.
+template <typename T>
+std::string keyBuildOptions(const cl::Device& device)
+{
+    if constexpr (std::is_same_v<T, cl_int>)
+        return "";
+    else if constexpr (std::is_same_v<T, cl_long>)
+        return "-D key_t=long";
+    else if constexpr (std::is_same_v<T, cl_uint>)
+        return "-D key_t=uint";
+    else if constexpr (std::is_same_v<T, cl_float>)
+        return "-D key_t=float";
+    else if constexpr (std::is_same_v<T, cl_double>)
+    {
+        if (device.getInfo<CL_DEVICE_EXTENSIONS>().find("cl_khr_fp64") == std::string::npos)
+            throw std::runtime_error("Device does not support double precision keys (cl_khr_fp64)");
+
+        return "-D key_t=double -D key_fp64";
+    }
+    else
+        static_assert(!std::is_same_v<T, T>, "Unsupported key type");
+}
+
+template <typename T>
+std::string buildOptions(const cl::Device& device, size_t n)
+{
+    std::string key = keyBuildOptions<T>(device);
+    std::string index = indexBuildOptions(n);
+
+    return (key.empty() || index.empty()) ? key + index : key + " " + index;
+}
+
+// Fills the device buffer behind the keys up to a power of two, so it must
+// not sort before any key. Float keys are never NaN, NpyReader rejects them.
+template <typename T>
+constexpr T paddingKey()
+{
+    if constexpr (std::numeric_limits<T>::has_infinity)
+        return std::numeric_limits<T>::infinity();
+    else
+        return std::numeric_limits<T>::max();
+}
+
+// Largest power of two tile that fits both the work-group size and local memory
+template <typename T = int>
+size_t localTileSize(const cl::Device& device)
+{
+    size_t maxItems = std::min<size_t>(device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>(),
+                                       device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>() / sizeof(T));
+
+    size_t tile = 1;
+    while (tile * 2 <= maxItems)
+        tile *= 2;
+
+    return tile;
+}
+
+// Sorts n (power of two) keys of buffer in place, n must not exceed the buffer size.
+// Index is cl_int or cl_long and must match the index_t the program was built with,
+// T must match its key_t. With a profile every launch is recorded under its stage,
+// as moving every key of the buffer in and out of global memory once.
+template <typename Index, typename T = int>
+void enqueueNetwork(const cl::CommandQueue& queue, const cl::Program& program, const cl::Buffer& buffer, 
+                    size_t n, Network network, size_t localSize_max, size_t firstStage = 2, 
+                    Profile* profile = nullptr)
+{
+    NetworkSchedule schedule = getNetworkSchedule(network);
+
+    cl::Kernel gkernel(program, schedule.gkernelName);
+    cl::Kernel lkernel(program, schedule.lkernelName);
+
+    size_t globalSize = n / schedule.elementsPerItem;
+
+    for (size_t stage = firstStage; stage <= n; stage *= 2)
+    {
+        size_t localSize = stage / schedule.elementsPerItem;
+
+        if (localSize <= localSize_max)
+        {
+            lkernel.setArg(0, buffer);
+            lkernel.setArg(1, (Index)stage);
+            lkernel.setArg(2, cl::Local(sizeof(T) * stage));
+            lkernel.setArg(3, (Index)n);
+            
+            queue.enqueueNDRangeKernel(
+                lkernel, 
+                cl::NullRange,
+                cl::NDRange(globalSize),
+                cl::NDRange(localSize),
+                nullptr,
+                profileEvent(profile, queue, ProfileKind::LocalStage, schedule.lkernelName, stage, 2 * sizeof(T) * n)
+            );
+        }
+        else
+        {   
+            for (size_t subStage = stage / 2; subStage > 0; subStage /= 2)
+            {   
+                gkernel.setArg(0, buffer);
+                gkernel.setArg(1, (Index)stage);
+                gkernel.setArg(2, (Index)subStage);
+                gkernel.setArg(3, 1);
+                
+                queue.enqueueNDRangeKernel(
+                    gkernel, 
+                    cl::NullRange,
+                    cl::NDRange(globalSize),
+                    cl::NullRange,
+                    nullptr,
+                    profileEvent(profile, queue, ProfileKind::GlobalStage, schedule.gkernelName, stage, 2 * sizeof(T) * n,
+                                 subStage)
+                );
+                
+                finishQueue(queue);
+            }
+        }
+        
+        finishQueue(queue);
+    }
+}
+
+template <typename Index, typename T = int>
+void enqueueTranspose(const cl::CommandQueue& queue, cl::Kernel& tkernel, const cl::Buffer& src, const cl::Buffer& dst,
+                      size_t rows, size_t cols, size_t localSize_max, cl::Event* event = nullptr)
+{
+    size_t tileSize = std::min<size_t>({16, rows, cols});
+
+    while (tileSize * tileSize > localSize_max)
+        tileSize /= 2;
+
+    tkernel.setArg(0, src);
+    tkernel.setArg(1, dst);
+    tkernel.setArg(2, (Index)rows);
+    tkernel.setArg(3, (Index)cols);
+    tkernel.setArg(4, cl::Local(sizeof(T) * tileSize * (tileSize + 1)));
+
+    queue.enqueueNDRangeKernel(
+        tkernel, 
+        cl::NullRange,
+        cl::NDRange(cols, rows),
+        cl::NDRange(tileSize, tileSize),
+        nullptr,
+        event
+    );
+}
+
+template <typename Index, typename T = int>
+void enqueueMerge(const cl::CommandQueue& queue, cl::Kernel& mkernel, const cl::Buffer& buffer, 
+                  size_t n, size_t tile, Index dirMask, int subStageStart, cl::Event* event = nullptr)
+{
+    mkernel.setArg(0, buffer);
+    mkernel.setArg(1, dirMask);
+    mkernel.setArg(2, subStageStart);
+    mkernel.setArg(3, cl::Local(sizeof(T) * tile));
+
+    queue.enqueueNDRangeKernel(
+        mkernel, 
+        cl::NullRange,
+        cl::NDRange(n),
+        cl::NDRange(tile),
+        nullptr,
+        event
+    );
+}
+
+// Bitonic network where substages with stride >= tile are not run as one
+// global pass each. The array is viewed as a (n / tile) x tile matrix and
+// transposed, which turns a stride of s into s / tile, so all strides from
+// stage / 2 down to tile are merged by one local kernel; after transposing
+// back the strides below tile are merged locally as well. Only strides of
+// tile^2 and more still need the global kernel.
+template <typename Index, typename T = int>
+void enqueueTransposedBitonic(const cl::Context& context, const cl::CommandQueue& queue, const cl::Program& program, 
+                              const cl::Buffer& buffer, size_t n, size_t tile, Profile* profile = nullptr)
+{
+    if (n <= tile)
+    {
+        enqueueNetwork<Index, T>(queue, program, buffer, n, Network::Bitonic, tile, 2, profile);
+        return;
+    }
+
+    cl::Kernel lkernel(program, "bitonicStep_lkernel");
+    cl::Kernel gkernel(program, "bitonicStep_gkernel");
+    cl::Kernel mkernel(program, "bitonicMerge_lkernel");
+    cl::Kernel tkernel(program, "transpose_kernel");
+
+    cl::Buffer transposed = deviceBuffer(context, CL_MEM_READ_WRITE, sizeof(T) * n);
+
+    size_t rows = n / tile;
+
+    for (size_t stage = 2; stage <= tile; stage *= 2)
+    {
+        lkernel.setArg(0, buffer);
+        lkernel.setArg(1, (Index)stage);
+        lkernel.setArg(2, cl::Local(sizeof(T) * stage));
+        lkernel.setArg(3, (Index)n);
+        
+        queue.enqueueNDRangeKernel(
+            lkernel, 
+            cl::NullRange,
+            cl::NDRange(n),
+            cl::NDRange(stage),
+            nullptr,
+            profileEvent(profile, queue, ProfileKind::LocalStage, "bitonicStep_lkernel", stage, 2 * sizeof(T) * n)
+        );
+    }
+
+    for (size_t stage = tile * 2; stage <= n; stage *= 2)
+    {
+        for (size_t subStage = stage / 2; subStage >= tile * tile; subStage /= 2)
+        {
+            gkernel.setArg(0, buffer);
+            gkernel.setArg(1, (Index)stage);
+            gkernel.setArg(2, (Index)subStage);
+            gkernel.setArg(3, 1);
+
+            queue.enqueueNDRangeKernel(
+                gkernel, 
+                cl::NullRange,
+                cl::NDRange(n),
+                cl::NullRange,
+                nullptr,
+                profileEvent(profile, queue, ProfileKind::GlobalStage, "bitonicStep_gkernel", stage, 2 * sizeof(T) * n,
+                             subStage)
+            );
+        }
+
+        // In the transposed layout bit (stage / tile) of the index is the
+        // direction bit, the last stage sorts everything ascending
+        Index transposedDirMask = (stage < n) ? stage / tile : 0;
+        int transposedStart = std::min(stage / 2, tile * tile / 2) / tile;
+
+        enqueueTranspose<Index, T>(queue, tkernel, buffer, transposed, rows, tile, tile,
+                                   profileEvent(profile, queue, ProfileKind::Kernel, "transpose_kernel", stage, 2 * sizeof(T) * n));
+        enqueueMerge<Index, T>(queue, mkernel, transposed, n, tile, transposedDirMask, transposedStart,
+                               profileEvent(profile, queue, ProfileKind::LocalStage, "bitonicMerge_lkernel", stage, 2 * sizeof(T) * n));
+        enqueueTranspose<Index, T>(queue, tkernel, transposed, buffer, tile, rows, tile,
+                                   profileEvent(profile, queue, ProfileKind::Kernel, "transpose_kernel", stage, 2 * sizeof(T) * n));
+        enqueueMerge<Index, T>(queue, mkernel, buffer, n, tile, (Index)stage, tile / 2,
+                               profileEvent(profile, queue, ProfileKind::LocalStage, "bitonicMerge_lkernel", stage, 2 * sizeof(T) * n));
+    }
+
+    finishQueue(queue);
+}
+
+bool isCpuDevice(const cl::Device& device)
+{
+    return device.getInfo<CL_DEVICE_TYPE>() & CL_DEVICE_TYPE_CPU;
+}
+
+// Block of a CPU work item: half of the cache, but small enough to give
+// every compute unit at least one block
+template <typename T = int>
+size_t cpuBlockSize(const cl::Device& device, size_t n)
+{
+    size_t cacheInts = device.getInfo<CL_DEVICE_GLOBAL_MEM_CACHE_SIZE>() / sizeof(T);
+    size_t units = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+
+    if (cacheInts == 0)
+        cacheInts = 64 * 1024;
+
+    size_t block = std::min(cacheInts / 2, n / std::max<size_t>(units, 1));
+
+    return std::clamp(std::bit_floor(std::max<size_t>(block, 1)), std::min<size_t>(2, n), n);
+}
+
+// Bitonic network with the CPU kernel family: blocks are sorted by one work
+// item each, then every stage runs its large strides block by block and
+// finishes the small strides inside each block.
+template <typename Index, typename T = int>
+void enqueueCpuBitonic(const cl::CommandQueue& queue, const cl::Program& program, const cl::Buffer& buffer, 
+                       size_t n, size_t block, Profile* profile = nullptr)
+{
+    cl::Kernel skernel(program, "bitonicBlockSort_ckernel");
+    cl::Kernel gkernel(program, "bitonicBlockStep_ckernel");
+    cl::Kernel mkernel(program, "bitonicBlockMerge_ckernel");
+
+    size_t globalSize = n / block;
+
+    skernel.setArg(0, buffer);
+    skernel.setArg(1, (int)block);
+
+    queue.enqueueNDRangeKernel(skernel, cl::NullRange, cl::NDRange(globalSize), cl::NullRange, nullptr,
+                               profileEvent(profile, queue, ProfileKind::LocalStage, "bitonicBlockSort_ckernel", block,
+                                            2 * sizeof(T) * n));
+
+    for (size_t stage = block * 2; stage <= n; stage *= 2)
+    {
+        for (size_t subStage = stage / 2; subStage >= block; subStage /= 2)
+        {
+            gkernel.setArg(0, buffer);
+            gkernel.setArg(1, (Index)stage);
+            gkernel.setArg(2, (Index)subStage);
+            gkernel.setArg(3, (int)block);
+
+            queue.enqueueNDRangeKernel(gkernel, cl::NullRange, cl::NDRange(globalSize), cl::NullRange, nullptr,
+                                       profileEvent(profile, queue, ProfileKind::GlobalStage, "bitonicBlockStep_ckernel", stage,
+                                                    2 * sizeof(T) * n, subStage));
+        }
+
+        mkernel.setArg(0, buffer);
+        mkernel.setArg(1, (Index)stage);
+        mkernel.setArg(2, (int)block);
+
+        queue.enqueueNDRangeKernel(mkernel, cl::NullRange, cl::NDRange(globalSize), cl::NullRange, nullptr,
+                                   profileEvent(profile, queue, ProfileKind::LocalStage, "bitonicBlockMerge_ckernel", stage,
+                                                2 * sizeof(T) * n));
+    }
+
+    finishQueue(queue);
+}
+
+// Digest of a key sequence on the device for --verify. The sum and the xor
+// of the mixed keys are the same for any permutation of the same keys, so
+// the digest of the input and the digest of the sorted keys must agree, and
+// the sorted keys must also be in ascending order. Unlike a comparison with
+// std::sort it costs one read of the keys on the device.
+struct KeyDigest
+{
+    cl_ulong sum    = 0;
+    cl_ulong mixed  = 0;
+    bool     sorted = true;
+
+    bool sameKeys(const KeyDigest& other) const { return sum == other.sum && mixed == other.mixed; }
+};
+
+// Digest of the first n keys of buffer. Index and T must match the program
+// as in enqueueNetwork(). Only the partial digests of at most 256 groups are
+// read back.
+template <typename Index, typename T = int>
+KeyDigest digestKeys(const cl::Context& context, const cl::CommandQueue& queue, const cl::Program& program,
+                     const cl::Device& device, const cl::Buffer& buffer, size_t n, Profile* profile = nullptr)
+{
+    constexpr size_t maxGroups = 256;
+
+    KeyDigest digest;
+
+    if (n == 0)
+        return digest;
+
+    // Every work item keeps a sum and a xor in local memory
+    struct Partial { cl_ulong sum, mixed; };
+
+    size_t localSize = std::min<size_t>(localTileSize<Partial>(device), 256);
+    size_t groups = std::min(maxGroups, (n + localSize - 1) / localSize);
+
+    cl::Buffer sums = deviceBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_ulong) * groups);
+    cl::Buffer xors = deviceBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_ulong) * groups);
+    cl::Buffer unsorted = deviceBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint));
+
+    queue.enqueueFillBuffer(unsorted, cl_uint(0), 0, sizeof(cl_uint), nullptr,
+                            profileEvent(profile, queue, ProfileKind::DeviceCopy, "digest clear", 0, sizeof(cl_uint)));
+
+    cl::Kernel kernel(program, "verifyDigest_kernel");
+
+    kernel.setArg(0, buffer);
+    kernel.setArg(1, (Index)n);
+    kernel.setArg(2, sums);
+    kernel.setArg(3, xors);
+    kernel.setArg(4, unsorted);
+    kernel.setArg(5, cl::Local(sizeof(cl_ulong) * localSize));
+    kernel.setArg(6, cl::Local(sizeof(cl_ulong) * localSize));
+
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(groups * localSize), cl::NDRange(localSize), nullptr,
+                               profileEvent(profile, queue, ProfileKind::Kernel, "verifyDigest_kernel", 0, sizeof(T) * n));
+
+    std::vector<cl_ulong> groupSums(groups);
+    std::vector<cl_ulong> groupXors(groups);
+    cl_uint inversion = 0;
+
+    queue.enqueueReadBuffer(sums, CL_FALSE, 0, sizeof(cl_ulong) * groups, groupSums.data(), nullptr,
+                            profileEvent(profile, queue, ProfileKind::Download, "digest", 0, sizeof(cl_ulong) * groups));
+    queue.enqueueReadBuffer(xors, CL_FALSE, 0, sizeof(cl_ulong) * groups, groupXors.data(), nullptr,
+                            profileEvent(profile, queue, ProfileKind::Download, "digest", 0, sizeof(cl_ulong) * groups));
+    queue.enqueueReadBuffer(unsorted, CL_TRUE, 0, sizeof(cl_uint), &inversion, nullptr,
+                            profileEvent(profile, queue, ProfileKind::Download, "digest", 0, sizeof(cl_uint)));
+
+    for (size_t group = 0; group < groups; ++group)
+    {
+        digest.sum += groupSums[group];
+        digest.mixed ^= groupXors[group];
+    }
+
+    digest.sorted = inversion == 0;
+
+    return digest;
+}
+
+// Throws unless sorted is the digest of input's keys in ascending order
+void checkDigests(const KeyDigest& input, const KeyDigest& sorted)
+{
+    if (!sorted.sorted)
+        throw std::runtime_error("Verification failed: the sorted keys are out of order");
+
+    if (!input.sameKeys(sorted))
+        throw std::runtime_error("Verification failed: the sorted keys are not a permutation of the input");
+}
+
+// Keys go to the device straight from input and come back straight into
+// output (the two may alias). The device buffer is padded to a power of two
+// with paddingKey<T>(), so input needs no spare capacity. With verify the
+// sorted keys are checked against a digest of the input on the device
+// before they are read back.
+template <typename T>
+void networkSort(const T* input, T* output, size_t n, const cl::Device& device, const std::string& kernelSource, 
+                 Network network, bool transposed = false, Profile* profile = nullptr, bool verify = false)
+{
+    if (transposed && network != Network::Bitonic)
+        throw std::invalid_argument("Transposed layout is implemented for the bitonic network only");
+
+    if (n == 0)
+        return;
+
+    cl::Context context(device);
+    cl::CommandQueue queue(context, device, queueProperties(profile));
+
+    size_t padded = std::bit_ceil(n);
+
+    cl::Buffer buffer = deviceBuffer(context, CL_MEM_READ_WRITE, sizeof(T) * padded);
+
+    queue.enqueueWriteBuffer(buffer, CL_FALSE, 0, sizeof(T) * n, input, nullptr,
+                             profileEvent(profile, queue, ProfileKind::Upload, "upload", 0, sizeof(T) * n));
+
+    if (padded > n)
+        queue.enqueueFillBuffer(buffer, paddingKey<T>(), sizeof(T) * n, sizeof(T) * (padded - n), nullptr,
+                                profileEvent(profile, queue, ProfileKind::DeviceCopy, "padding", 0, sizeof(T) * (padded - n)));
+
+    cl::Program program = buildProgram(context, device, kernelSource, buildOptions<T>(device, padded), profile);
+
+    auto digest = [&] {
+        return needsWideIndex(padded) ? digestKeys<cl_long, T>(context, queue, program, device, buffer, n, profile)
+                                      : digestKeys<cl_int, T>(context, queue, program, device, buffer, n, profile);
+    };
+
+    KeyDigest inputDigest;
+
+    if (verify)
+        inputDigest = digest();
+
+    if (transposed)
+    {
+        size_t tile = localTileSize<T>(device);
+
+        if (needsWideIndex(padded))
+            enqueueTransposedBitonic<cl_long, T>(context, queue, program, buffer, padded, tile, profile);
+        else
+            enqueueTransposedBitonic<cl_int, T>(context, queue, program, buffer, padded, tile, profile);
+    }
+    else
+    {
+        size_t localSize_max = device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
+
+        if (needsWideIndex(padded))
+            enqueueNetwork<cl_long, T>(queue, program, buffer, padded, network, localSize_max, 2, profile);
+        else
+            enqueueNetwork<cl_int, T>(queue, program, buffer, padded, network, localSize_max, 2, profile);
+    }
+
+    if (verify)
+        checkDigests(inputDigest, digest());
+
+    queue.enqueueReadBuffer(buffer, CL_TRUE, 0, sizeof(T) * n, output, nullptr,
+                            profileEvent(profile, queue, ProfileKind::Download, "readback", 0, sizeof(T) * n));
+}
+
+template <typename T>
+void networkSort(std::vector<T>& sequence, const cl::Device& device, const std::string& kernelSource, 
+                 Network network, bool transposed = false)
+{
+    networkSort(sequence.data(), sequence.data(), sequence.size(), device, kernelSource, network, transposed);
+}
+
+template <typename T>
+void cpuBitonicSort(const T* input, T* output, size_t n, const cl::Device& device, const std::string& kernelSource,
+                    Profile* profile = nullptr, bool verify = false)
+{
+    if (n < 2)
+    {
+        if (input != output)
+            std::copy_n(input, n, output);
+        return;
+    }
+
+    cl::Context context(device);
+    cl::CommandQueue queue(context, device, queueProperties(profile));
+
+    size_t padded = std::bit_ceil(n);
+
+    // The device shares host memory, so an in-place power of two sequence is
+    // sorted where it lies instead of being copied in and out
+    bool zeroCopy = (input == output) && (padded == n);
+
+    cl::Buffer buffer = zeroCopy ? deviceBuffer(context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, sizeof(T) * n, output)
+                                 : deviceBuffer(context, CL_MEM_READ_WRITE, sizeof(T) * padded);
+
+    if (!zeroCopy)
+        queue.enqueueWriteBuffer(buffer, CL_FALSE, 0, sizeof(T) * n, input, nullptr,
+                                 profileEvent(profile, queue, ProfileKind::Upload, "upload", 0, sizeof(T) * n));
+
+    if (padded > n)
+        queue.enqueueFillBuffer(buffer, paddingKey<T>(), sizeof(T) * n, sizeof(T) * (padded - n), nullptr,
+                                profileEvent(profile, queue, ProfileKind::DeviceCopy, "padding", 0, sizeof(T) * (padded - n)));
+
+    cl::Program program = buildProgram(context, device, kernelSource, buildOptions<T>(device, padded), profile);
+
+    auto digest = [&] {
+        return needsWideIndex(padded) ? digestKeys<cl_long, T>(context, queue, program, device, buffer, n, profile)
+                                      : digestKeys<cl_int, T>(context, queue, program, device, buffer, n, profile);
+    };
+
+    KeyDigest inputDigest;
+
+    if (verify)
+        inputDigest = digest();
+
+    if (needsWideIndex(padded))
+        enqueueCpuBitonic<cl_long, T>(queue, program, buffer, padded, cpuBlockSize<T>(device, padded), profile);
+    else
+        enqueueCpuBitonic<cl_int, T>(queue, program, buffer, padded, cpuBlockSize<T>(device, padded), profile);
+
+    if (verify)
+        checkDigests(inputDigest, digest());
+
+    if (zeroCopy)
+    {
+        void* mapped = queue.enqueueMapBuffer(buffer, CL_TRUE, CL_MAP_READ, 0, sizeof(T) * n, nullptr,
+                                              profileEvent(profile, queue, ProfileKind::Download, "map"));
+        queue.enqueueUnmapMemObject(buffer, mapped);
+        finishQueue(queue);
+    }
+    else
+    {
+        queue.enqueueReadBuffer(buffer, CL_TRUE, 0, sizeof(T) * n, output, nullptr,
+                                profileEvent(profile, queue, ProfileKind::Download, "readback", 0, sizeof(T) * n));
+    }
+}
+
+template <typename T>
+void cpuBitonicSort(std::vector<T>& sequence, const cl::Device& device, const std::string& kernelSource)
+{
+    cpuBitonicSort(sequence.data(), sequence.data(), sequence.size(), device, kernelSource);
+}
+
+template <typename T>
+void bitonicSort_modernized(std::vector<T>& sequence, const cl::Device& device, const std::string& kernelSource)
+{
+    networkSort(sequence, device, kernelSource, Network::Bitonic);
+}
+
+// Batcher's odd-even merge sort: fewer comparators than bitonic, same launch loop
+template <typename T>
+void oddEvenMergeSort(std::vector<T>& sequence, const cl::Device& device, const std::string& kernelSource)
+{
+    networkSort(sequence, device, kernelSource, Network::OddEvenMerge);
+}
+
+// MSD radix partition followed by segmented local sorts. The keys are
+// scattered into buckets by the top bits of (key - min), the bucket count is
+// chosen so that a bucket holds about half a tile, and every bucket is then
+// sorted by a single work group in local memory. Buckets that still exceed
+// a tile (skewed input, or more keys than 2^20 buckets cover) go through
+// more MSD levels on their next bits first. Does not need a power of two
+// input.
+template <typename T>
+void radixBucketSort(const T* input, T* output, size_t n, const cl::Device& device, const std::string& kernelSource,
+                     Profile* profile = nullptr, bool verify = false)
+{
+    static_assert(std::is_same_v<T, cl_int>, "Radix bucket engine sorts 32-bit signed keys only");
+
+    if (needsWideIndex(n))
+        throw std::length_error("Radix bucket engine supports at most INT_MAX keys, use the network engine");
+
+    auto [minIt, maxIt] = std::minmax_element(input, input + n);
+
+    if (n < 2 || *minIt == *maxIt)
+    {
+        if (input != output)
+            std::copy_n(input, n, output);
+        return;
+    }
+
+    int minKey = *minIt;
+    cl_uint range = static_cast<cl_uint>(*maxIt) - static_cast<cl_uint>(minKey);
+
+    cl::Context context(device);
+    cl::CommandQueue queue(context, device, queueProperties(profile));
+
+    cl::Program program = buildProgram(context, device, kernelSource, "", profile);
+
+    size_t tile = localTileSize(device);
+
+    int rangeBits = std::bit_width(range);
+    int bucketBits = std::bit_width((2 * n - 1) / tile);
+    bucketBits = std::clamp(bucketBits, 1, std::min(rangeBits, 20));
+
+    int shift = rangeBits - bucketBits;
+    size_t bucketsCount = size_t(1) << bucketBits;
+
+    cl::Buffer keys = deviceBuffer(context, CL_MEM_READ_WRITE, sizeof(int) * n);
+    cl::Buffer buckets = deviceBuffer(context, CL_MEM_READ_WRITE, sizeof(int) * n);
+    cl::Buffer histogram = deviceBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * (bucketsCount + 1));
+    cl::Buffer cursor = deviceBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * bucketsCount);
+
+    queue.enqueueWriteBuffer(keys, CL_FALSE, 0, sizeof(int) * n, input, nullptr,
+                             profileEvent(profile, queue, ProfileKind::Upload, "upload", 0, sizeof(int) * n));
+    queue.enqueueFillBuffer(histogram, cl_uint(0), 0, sizeof(cl_uint) * (bucketsCount + 1), nullptr,
+                            profileEvent(profile, queue, ProfileKind::DeviceCopy, "histogram clear", 0,
+                                         sizeof(cl_uint) * (bucketsCount + 1)));
+
+    KeyDigest inputDigest;
+
+    if (verify)
+        inputDigest = digestKeys<cl_int>(context, queue, program, device, keys, n, profile);
+
+    cl::Kernel hkernel(program, "radixHistogram_kernel");
+
+    hkernel.setArg(0, keys);
+    hkernel.setArg(1, histogram);
+    hkernel.setArg(2, minKey);
+    hkernel.setArg(3, shift);
+
+    queue.enqueueNDRangeKernel(hkernel, cl::NullRange, cl::NDRange(n), cl::NullRange, nullptr,
+                               profileEvent(profile, queue, ProfileKind::Kernel, "radixHistogram_kernel", 0, sizeof(int) * n));
+
+    std::vector<cl_uint> offsets(bucketsCount + 1);
+    queue.enqueueReadBuffer(histogram, CL_TRUE, 0, sizeof(cl_uint) * bucketsCount, offsets.data(), nullptr,
+                            profileEvent(profile, queue, ProfileKind::Download, "histogram", 0, sizeof(cl_uint) * bucketsCount));
+
+    std::exclusive_scan(offsets.begin(), offsets.end(), offsets.begin(), cl_uint(0));
+
+    queue.enqueueWriteBuffer(histogram, CL_FALSE, 0, sizeof(cl_uint) * (bucketsCount + 1), offsets.data(), nullptr,
+                             profileEvent(profile, queue, ProfileKind::Upload, "offsets", 0, sizeof(cl_uint) * (bucketsCount + 1)));
+    queue.enqueueWriteBuffer(cursor, CL_FALSE, 0, sizeof(cl_uint) * bucketsCount, offsets.data(), nullptr,
+                             profileEvent(profile, queue, ProfileKind::Upload, "offsets", 0, sizeof(cl_uint) * bucketsCount));
+
+    cl::Kernel skernel(program, "radixScatter_kernel");
+
+    skernel.setArg(0, keys);
+    skernel.setArg(1, buckets);
+    skernel.setArg(2, cursor);
+    skernel.setArg(3, minKey);
+    skernel.setArg(4, shift);
+
+    queue.enqueueNDRangeKernel(skernel, cl::NullRange, cl::NDRange(n), cl::NullRange, nullptr,
+                               profileEvent(profile, queue, ProfileKind::Kernel, "radixScatter_kernel", 0, 2 * sizeof(int) * n));
+
+    // Buckets still larger than a tile are split again by their next bits,
+    // one histogram and one scatter over all keys per level, until every
+    // bucket fits a tile or holds a single key value (shift 0)
+    std::vector<int> shifts(bucketsCount, shift);
+
+    for (;;)
+    {
+        std::vector<cl_uint> firstChild(bucketsCount + 1, 0);
+        std::vector<cl_int> childShift(bucketsCount);
+        bool split = false;
+
+        for (size_t bucket = 0; bucket < bucketsCount; ++bucket)
+        {
+            size_t count = offsets[bucket + 1] - offsets[bucket];
+            int bits = 0;
+
+            if (count > tile && shifts[bucket] > 0)
+            {
+                bits = std::min(static_cast<int>(std::bit_width((2 * count - 1) / tile)), shifts[bucket]);
+                split = true;
+            }
+
+            childShift[bucket] = shifts[bucket] - bits;
+            firstChild[bucket + 1] = firstChild[bucket] + (cl_uint(1) << bits);
+        }
+
+        if (!split)
+            break;
+
+        size_t childrenCount = firstChild[bucketsCount];
+
+        cl::Buffer firstChildBuffer = deviceBuffer(context, CL_MEM_READ_ONLY, sizeof(cl_uint) * (bucketsCount + 1));
+        cl::Buffer childShiftBuffer = deviceBuffer(context, CL_MEM_READ_ONLY, sizeof(cl_int) * bucketsCount);
+        cl::Buffer childHistogram = deviceBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * (childrenCount + 1));
+
+        cursor = deviceBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * childrenCount);
+
+        queue.enqueueWriteBuffer(firstChildBuffer, CL_FALSE, 0, sizeof(cl_uint) * (bucketsCount + 1), firstChild.data(), nullptr,
+                                 profileEvent(profile, queue, ProfileKind::Upload, "children", 0, sizeof(cl_uint) * (bucketsCount + 1)));
+        queue.enqueueWriteBuffer(childShiftBuffer, CL_FALSE, 0, sizeof(cl_int) * bucketsCount, childShift.data(), nullptr,
+                                 profileEvent(profile, queue, ProfileKind::Upload, "children", 0, sizeof(cl_int) * bucketsCount));
+        queue.enqueueFillBuffer(childHistogram, cl_uint(0), 0, sizeof(cl_uint) * (childrenCount + 1), nullptr,
+                                profileEvent(profile, queue, ProfileKind::DeviceCopy, "histogram clear", 0,
+                                             sizeof(cl_uint) * (childrenCount + 1)));
+
+        cl::Kernel rhkernel(program, "refineHistogram_kernel");
+
+        rhkernel.setArg(0, buckets);
+        rhkernel.setArg(1, histogram);
+        rhkernel.setArg(2, static_cast<cl_uint>(bucketsCount));
+        rhkernel.setArg(3, firstChildBuffer);
+        rhkernel.setArg(4, childShiftBuffer);
+        rhkernel.setArg(5, childHistogram);
+        rhkernel.setArg(6, minKey);
+
+        queue.enqueueNDRangeKernel(rhkernel, cl::NullRange, cl::NDRange(n), cl::NullRange, nullptr,
+                                   profileEvent(profile, queue, ProfileKind::Kernel, "refineHistogram_kernel", 0, sizeof(int) * n));
+
+        std::vector<cl_uint> childOffsets(childrenCount + 1);
+        queue.enqueueReadBuffer(childHistogram, CL_TRUE, 0, sizeof(cl_uint) * childrenCount, childOffsets.data(), nullptr,
+                                profileEvent(profile, queue, ProfileKind::Download, "histogram", 0, sizeof(cl_uint) * childrenCount));
+
+        std::exclusive_scan(childOffsets.begin(), childOffsets.end(), childOffsets.begin(), cl_uint(0));
+
+        // childOffsets moves into offsets below, which outlives both writes:
+        // the next blocking read drains the in-order queue first
+        queue.enqueueWriteBuffer(childHistogram, CL_FALSE, 0, sizeof(cl_uint) * (childrenCount + 1), childOffsets.data(), nullptr,
+                                 profileEvent(profile, queue, ProfileKind::Upload, "offsets", 0, sizeof(cl_uint) * (childrenCount + 1)));
+        queue.enqueueWriteBuffer(cursor, CL_FALSE, 0, sizeof(cl_uint) * childrenCount, childOffsets.data(), nullptr,
+                                 profileEvent(profile, queue, ProfileKind::Upload, "offsets", 0, sizeof(cl_uint) * childrenCount));
+
+        cl::Kernel rskernel(program, "refineScatter_kernel");
+
+        rskernel.setArg(0, buckets);
+        rskernel.setArg(1, keys);
+        rskernel.setArg(2, histogram);
+        rskernel.setArg(3, static_cast<cl_uint>(bucketsCount));
+        rskernel.setArg(4, firstChildBuffer);
+        rskernel.setArg(5, childShiftBuffer);
+        rskernel.setArg(6, cursor);
+        rskernel.setArg(7, minKey);
+
+        queue.enqueueNDRangeKernel(rskernel, cl::NullRange, cl::NDRange(n), cl::NullRange, nullptr,
+                                   profileEvent(profile, queue, ProfileKind::Kernel, "refineScatter_kernel", 0, 2 * sizeof(int) * n));
+
+        std::vector<int> childShifts(childrenCount);
+
+        for (size_t bucket = 0; bucket < bucketsCount; ++bucket)
+            std::fill(childShifts.begin() + firstChild[bucket], childShifts.begin() + firstChild[bucket + 1], childShift[bucket]);
+
+        std::swap(keys, buckets);
+        histogram = childHistogram;
+        offsets = std::move(childOffsets);
+        shifts = std::move(childShifts);
+        bucketsCount = childrenCount;
+    }
+
+    cl::Kernel bkernel(program, "bucketSort_lkernel");
+
+    bkernel.setArg(0, buckets);
+    bkernel.setArg(1, histogram);
+    bkernel.setArg(2, cl::Local(sizeof(int) * tile));
+
+    queue.enqueueNDRangeKernel(
+        bkernel, 
+        cl::NullRange,
+        cl::NDRange(bucketsCount * tile),
+        cl::NDRange(tile),
+        nullptr,
+        profileEvent(profile, queue, ProfileKind::LocalStage, "bucketSort_lkernel", 0, 2 * sizeof(int) * n)
+    );
+
+    if (verify)
+        checkDigests(inputDigest, digestKeys<cl_int>(context, queue, program, device, buckets, n, profile));
+
+    queue.enqueueReadBuffer(buckets, CL_TRUE, 0, sizeof(int) * n, output, nullptr,
+                            profileEvent(profile, queue, ProfileKind::Download, "readback", 0, sizeof(int) * n));
+}
+
+template <typename T>
+void radixBucketSort(std::vector<T>& sequence, const cl::Device& device, const std::string& kernelSource)
+{
+    radixBucketSort(sequence.data(), sequence.data(), sequence.size(), device, kernelSource);
+}
+
+enum class Engine
+{
+    Network,
+    RadixBucket
+};
+
+Engine parseEngine(std::string_view name)
+{
+    if (name == "network")
+        return Engine::Network;
+
+    if (name == "radix")
+        return Engine::RadixBucket;
+
+    throw std::invalid_argument("Unknown sorting engine: " + std::string(name) + 
+                                ". Expected network or radix");
+}
+
+struct SortConfig
+{
+    Engine   engine     = Engine::Network;
+    Network  network    = Network::Bitonic;
+    bool     transposed = false;
+    Profile* profile    = nullptr; // records transfers, launches and builds
+    bool     verify     = false;   // checks the sorted keys on the device, see KeyDigest
+};
+
+// Sorts n keys from input into output, the two may alias. The network
+// engine pads to a power of two on the device. On CPU devices the bitonic
+// network switches to the block-per-work-item kernels, the transposed
+// layout does not apply there.
+template <typename T>
+void sort(const T* input, T* output, size_t n, const cl::Device& device, const std::string& kernelSource, 
+          const SortConfig& config)
+{
+    switch (config.engine)
+    {
+        case Engine::Network:
+            if (config.network == Network::Bitonic && isCpuDevice(device))
+                cpuBitonicSort(input, output, n, device, kernelSource, config.profile, config.verify);
+            else
+                networkSort(input, output, n, device, kernelSource, config.network, config.transposed, config.profile,
+                            config.verify);
+            return;
+        case Engine::RadixBucket:
+            if constexpr (std::is_same_v<T, cl_int>)
+                radixBucketSort(input, output, n, device, kernelSource, config.profile, config.verify);
+            else
+                throw std::invalid_argument("Radix bucket engine sorts 32-bit signed keys only, use the network engine");
+            return;
+    }
+}
+
+template <typename T>
+void sort(std::vector<T>& sequence, const cl::Device& device, const std::string& kernelSource, 
+          const SortConfig& config)
+{
+    sort(sequence.data(), sequence.data(), sequence.size(), device, kernelSource, config);
+}
+
+// Stable argsort of 32-bit keys: every key is packed with its index into one
+// 64-bit key, key in the high half, and the packed keys are sorted on the
+// device as they are. Equal keys keep their order because the index breaks
+// the tie, the order is read back from the low halves.
+std::vector<uint32_t> argsort(const int32_t* keys, size_t n, const cl::Device& device, const std::string& kernelSource,
+                              const SortConfig& config)
+{
+    if (n > std::numeric_limits<uint32_t>::max())
+        throw std::length_error("Argsort supports at most 2^32 keys");
+
+    std::vector<cl_long> packed(n);
+
+    for (size_t i = 0; i < n; ++i)
+        packed[i] = (static_cast<cl_long>(keys[i]) << 32) | static_cast<cl_long>(i);
+
+    sort(packed.data(), packed.data(), n, device, kernelSource, config);
+
+    std::vector<uint32_t> order(n);
+
+    for (size_t i = 0; i < n; ++i)
+        order[i] = static_cast<uint32_t>(packed[i]);
+
+    return order;
+}
+
+// Sorts the first n (a power of two) keys of buffer with the network engine
+// the config selects for the device, as sort() does for a whole sequence.
+// Index and T must match the program as in enqueueNetwork().
+template <typename Index, typename T = int>
+void enqueueChunkSort(const cl::Context& context, const cl::CommandQueue& queue, const cl::Program& program,
+                      const cl::Device& device, const cl::Buffer& buffer, size_t n, const SortConfig& config)
+{
+    if (n < 2)
+        finishQueue(queue);
+    else if (config.network == Network::Bitonic && isCpuDevice(device))
+        enqueueCpuBitonic<Index, T>(queue, program, buffer, n, cpuBlockSize<T>(device, n), config.profile);
+    else if (config.transposed)
+        enqueueTransposedBitonic<Index, T>(context, queue, program, buffer, n, localTileSize<T>(device), config.profile);
+    else
+        enqueueNetwork<Index, T>(queue, program, buffer, n, config.network, device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>(), 
+                                 2, config.profile);
+}
+
+// Sorts the numbers of a stream while it is still being read. A reader
+// thread parses chunks of chunkSize keys, every chunk is uploaded and sorted
+// on the device as soon as it is complete while the next one is parsed. At
+// the end of the stream the sorted chunks are laid out in one buffer and
+// merged by the odd-even merge stages above chunkSize, which merge ascending
+// runs as they are. With countHeader the stream starts with the count of the
+// keys, as input_stdin() expects, and must hold exactly that many; without it
+// every number is a key.
 template <typename T>
-void bitonicSort_modernized(std::vector<T>& sequence, const cl::Device& device, const std::string& kernelSource)
+std::vector<T> streamSort(std::streambuf* source, const cl::Device& device, const std::string& kernelSource,
+                          const SortConfig& config, bool countHeader = true, size_t chunkSize = size_t(1) << 20)
 {
-    size_t n = sequence.size();
+    if (config.engine != Engine::Network)
+        throw std::invalid_argument("Streaming input is implemented for the network engine only");
 
-    cl::Context context(device);
-    cl::CommandQueue queue(context, device);
+    if (!std::has_single_bit(chunkSize))
+        throw std::invalid_argument("Stream chunk size must be a power of two");
 
-    cl::Buffer buffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, 
-                      sizeof(int) * sequence.size(), sequence.data());
+    if (config.transposed && config.network != Network::Bitonic)
+        throw std::invalid_argument("Transposed layout is implemented for the bitonic network only");
 
-    cl::Program program(context, kernelSource);
+    constexpr size_t maxQueued = 4;
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::vector<T>> parsed;
+    bool finished = false;
+    bool cancelled = false;
+    std::exception_ptr readerError;
+
+    std::thread reader([&]
+    {
+        try
+        {
+            StreamParser<T> parser(source);
+            size_t remaining = std::numeric_limits<size_t>::max();
+
+            if (countHeader)
+            {
+                long long count = 0;
+
+                if (parser.next(&count, 1) != 1)
+                    throw std::runtime_error("Invalid input. Expected a number at the beginning.");
+
+                if (count < 0)
+                    throw std::runtime_error("Number of elements must be non-negative");
+
+                remaining = static_cast<size_t>(count);
+            }
+
+            size_t expected = remaining;
+            bool last = false;
+
+            while (!last)
+            {
+                size_t wanted = std::min(chunkSize, remaining);
+
+                std::vector<T> chunk(wanted);
+                chunk.resize(parser.next(chunk.data(), wanted));
+
+                remaining -= chunk.size();
+                last = chunk.size() < chunkSize || remaining == 0;
+
+                if (countHeader && last)
+                {
+                    T extra{};
+
+                    if (remaining > 0)
+                        throw std::runtime_error("Stream contains fewer numbers than specified. Expected: " +
+                                                 std::to_string(expected) + ", got: " + std::to_string(expected - remaining));
+
+                    if (parser.next(&extra, 1) == 1)
+                        throw std::runtime_error("Stream contains more numbers than specified: " + std::to_string(expected));
+                }
+
+                std::unique_lock lock(mutex);
+                ready.wait(lock, [&] { return parsed.size() < maxQueued || cancelled; });
+
+                if (cancelled)
+                    return;
+
+                if (!chunk.empty())
+                    parsed.push_back(std::move(chunk));
+
+                ready.notify_all();
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard lock(mutex);
+            readerError = std::current_exception();
+        }
+
+        std::lock_guard lock(mutex);
+        finished = true;
+        ready.notify_all();
+    });
+
+    cl::Context context(device);
+    cl::CommandQueue queue(context, device, queueProperties(config.profile));
+
+    std::vector<cl::Buffer> chunks;
+    size_t total = 0;
+    size_t lastPadded = 0;
 
     try
     {
-        program.build(device);
+        cl::Program program = buildProgram(context, device, kernelSource, buildOptions<T>(device, chunkSize), config.profile);
+
+        while (true)
+        {
+            std::vector<T> chunk;
+
+            {
+                std::unique_lock lock(mutex);
+                ready.wait(lock, [&] { return !parsed.empty() || finished; });
+
+                if (parsed.empty())
+                    break;
+
+                chunk = std::move(parsed.front());
+                parsed.pop_front();
+                ready.notify_all();
+            }
+
+            // Only the last chunk can be partial, it is padded to a power of two of its own
+            size_t padded = std::bit_ceil(chunk.size());
+
+            cl::Buffer buffer = deviceBuffer(context, CL_MEM_READ_WRITE, sizeof(T) * padded);
+
+            // Blocking, chunk is freed at the end of the iteration. The reader
+            // thread keeps parsing the next chunk meanwhile.
+            queue.enqueueWriteBuffer(buffer, CL_TRUE, 0, sizeof(T) * chunk.size(), chunk.data(), nullptr,
+                                     profileEvent(config.profile, queue, ProfileKind::Upload, "upload", 0,
+                                                  sizeof(T) * chunk.size()));
+
+            if (padded > chunk.size())
+                queue.enqueueFillBuffer(buffer, paddingKey<T>(), sizeof(T) * chunk.size(), 
+                                        sizeof(T) * (padded - chunk.size()), nullptr,
+                                        profileEvent(config.profile, queue, ProfileKind::DeviceCopy, "padding", 0,
+                                                     sizeof(T) * (padded - chunk.size())));
+
+            if (needsWideIndex(chunkSize))
+                enqueueChunkSort<cl_long, T>(context, queue, program, device, buffer, padded, config);
+            else
+                enqueueChunkSort<cl_int, T>(context, queue, program, device, buffer, padded, config);
+
+            chunks.push_back(buffer);
+            total += chunk.size();
+            lastPadded = padded;
+        }
+
+        reader.join();
     }
     catch (...)
     {
-        std::string buildLog = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device);
-        std::cerr << "Build failed: " << buildLog << std::endl;
+        {
+            std::lock_guard lock(mutex);
+            cancelled = true;
+            ready.notify_all();
+        }
+
+        reader.join();
         throw;
     }
 
-    cl::Kernel gkernel(program, "bitonicStep_gkernel");
-    cl::Kernel lkernel(program, "bitonicStep_lkernel");
+    if (readerError)
+        std::rethrow_exception(readerError);
+
+    std::vector<T> result(total);
+
+    if (chunks.size() == 1)
+    {
+        queue.enqueueReadBuffer(chunks[0], CL_TRUE, 0, sizeof(T) * total, result.data(), nullptr,
+                                profileEvent(config.profile, queue, ProfileKind::Download, "readback", 0, sizeof(T) * total));
+        return result;
+    }
+
+    if (chunks.empty())
+        return result;
+
+    size_t n = std::bit_ceil(chunks.size()) * chunkSize;
+    size_t filled = (chunks.size() - 1) * chunkSize + lastPadded;
+
+    cl::Program program = buildProgram(context, device, kernelSource, buildOptions<T>(device, n), config.profile);
+    cl::Buffer merged = deviceBuffer(context, CL_MEM_READ_WRITE, sizeof(T) * n);
+
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        size_t size = (i + 1 < chunks.size()) ? chunkSize : lastPadded;
+        queue.enqueueCopyBuffer(chunks[i], merged, 0, sizeof(T) * i * chunkSize, sizeof(T) * size, nullptr,
+                                profileEvent(config.profile, queue, ProfileKind::DeviceCopy, "chunk copy", 0, 2 * sizeof(T) * size));
+    }
+
+    if (filled < n)
+        queue.enqueueFillBuffer(merged, paddingKey<T>(), sizeof(T) * filled, sizeof(T) * (n - filled), nullptr,
+                                profileEvent(config.profile, queue, ProfileKind::DeviceCopy, "padding", 0, sizeof(T) * (n - filled)));
+
+    finishQueue(queue);
+    chunks.clear();
 
     size_t localSize_max = device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
 
-    for (int stage = 2; stage <= n; stage *= 2)
+    if (needsWideIndex(n))
+        enqueueNetwork<cl_long, T>(queue, program, merged, n, Network::OddEvenMerge, localSize_max, 2 * chunkSize,
+                                   config.profile);
+    else
+        enqueueNetwork<cl_int, T>(queue, program, merged, n, Network::OddEvenMerge, localSize_max, 2 * chunkSize,
+                                  config.profile);
+
+    queue.enqueueReadBuffer(merged, CL_TRUE, 0, sizeof(T) * total, result.data(), nullptr,
+                            profileEvent(config.profile, queue, ProfileKind::Download, "readback", 0, sizeof(T) * total));
+
+    return result;
+}
+
+// Largest block for sortInBlocks: two blocks have to fit into one device allocation
+template <typename T = int>
+size_t deviceBlockSize(const cl::Device& device)
+{
+    size_t maxAlloc = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+
+    return std::bit_floor(maxAlloc / sizeof(T) / 2);
+}
+
+// Sorts n keys in place in host memory (e.g. a mapped file) that can be
+// larger than the device allocation limit, without another host copy.
+// Every block of blockSize keys is sorted on the device, then the blocks go
+// through Batcher's merge-exchange network (Knuth, Algorithm 5.2.2M) with a
+// merge-split as the comparator: both blocks are loaded, merged by the last
+// odd-even merge stage and written back, the lower half into the first
+// block. The partial last block is padded with paddingKey<T>() on the
+// device, the padding always ends up at the top of the merged pair and is
+// not written.
+template <typename T>
+void sortInBlocks(T* keys, size_t n, const cl::Device& device, const std::string& kernelSource,
+                  const SortConfig& config, size_t blockSize)
+{
+    if (std::bit_ceil(n) <= 2 * blockSize)
     {
-        if (stage <= localSize_max)
-        {
-            size_t localSize = stage;
-            
-            lkernel.setArg(0, buffer);
-            lkernel.setArg(1, stage);
-            lkernel.setArg(2, cl::Local(sizeof(int) * localSize));
-            lkernel.setArg(3, (int)n);
-            
-            queue.enqueueNDRangeKernel(
-                lkernel, 
-                cl::NullRange,
-                cl::NDRange(n),
-                cl::NDRange(localSize)
-            );
-        }
+        sort(keys, keys, n, device, kernelSource, config);
+        return;
+    }
+
+    if (config.engine != Engine::Network)
+        throw std::invalid_argument("Sorting in blocks is implemented for the network engine only");
+
+    if (!std::has_single_bit(blockSize))
+        throw std::invalid_argument("Block size must be a power of two");
+
+    cl::Context context(device);
+    cl::CommandQueue queue(context, device, queueProperties(config.profile));
+
+    cl::Program program = buildProgram(context, device, kernelSource, buildOptions<T>(device, 2 * blockSize), config.profile);
+    cl::Buffer buffer = deviceBuffer(context, CL_MEM_READ_WRITE, sizeof(T) * 2 * blockSize);
+
+    size_t localSize_max = device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
+    size_t blocksCount = (n + blockSize - 1) / blockSize;
+
+    auto blockLength = [&](size_t block) { return std::min(blockSize, n - block * blockSize); };
+
+    auto load = [&](size_t block, size_t offset)
+    {
+        size_t length = blockLength(block);
+
+        queue.enqueueWriteBuffer(buffer, CL_FALSE, sizeof(T) * offset, sizeof(T) * length, keys + block * blockSize,
+                                 nullptr, profileEvent(config.profile, queue, ProfileKind::Upload, "upload", 0, sizeof(T) * length));
+
+        if (length < blockSize)
+            queue.enqueueFillBuffer(buffer, paddingKey<T>(), sizeof(T) * (offset + length),
+                                    sizeof(T) * (blockSize - length), nullptr,
+                                    profileEvent(config.profile, queue, ProfileKind::DeviceCopy, "padding", 0,
+                                                 sizeof(T) * (blockSize - length)));
+    };
+
+    auto store = [&](size_t block, size_t offset)
+    {
+        queue.enqueueReadBuffer(buffer, CL_FALSE, sizeof(T) * offset, sizeof(T) * blockLength(block),
+                                keys + block * blockSize, nullptr,
+                                profileEvent(config.profile, queue, ProfileKind::Download, "readback", 0,
+                                             sizeof(T) * blockLength(block)));
+    };
+
+    for (size_t block = 0; block < blocksCount; ++block)
+    {
+        load(block, 0);
+
+        if (needsWideIndex(2 * blockSize))
+            enqueueChunkSort<cl_long, T>(context, queue, program, device, buffer, blockSize, config);
         else
-        {   
-            for (int subStage = stage / 2; subStage > 0; subStage /= 2)
-            {   
-                gkernel.setArg(0, buffer);
-                gkernel.setArg(1, stage);
-                gkernel.setArg(2, subStage);
-                gkernel.setArg(3, 1);
-                
-                queue.enqueueNDRangeKernel(
-                    gkernel, 
-                    cl::NullRange,
-                    cl::NDRange(n),
-                    cl::NullRange
-                );
-                
-                queue.finish();
+            enqueueChunkSort<cl_int, T>(context, queue, program, device, buffer, blockSize, config);
+
+        store(block, 0);
+    }
+
+    auto mergeSplit = [&](size_t lower, size_t upper)
+    {
+        load(lower, 0);
+        load(upper, blockSize);
+
+        if (needsWideIndex(2 * blockSize))
+            enqueueNetwork<cl_long, T>(queue, program, buffer, 2 * blockSize, Network::OddEvenMerge, localSize_max,
+                                       2 * blockSize, config.profile);
+        else
+            enqueueNetwork<cl_int, T>(queue, program, buffer, 2 * blockSize, Network::OddEvenMerge, localSize_max,
+                                      2 * blockSize, config.profile);
+
+        store(lower, 0);
+        store(upper, blockSize);
+        finishQueue(queue);
+    };
+
+    size_t top = std::bit_ceil(blocksCount) / 2;
+
+    for (size_t p = top; p > 0; p /= 2)
+    {
+        size_t q = top;
+        size_t r = 0;
+        size_t d = p;
+
+        while (true)
+        {
+            for (size_t i = 0; i + d < blocksCount; ++i)
+            {
+                if ((i & p) == r)
+                    mergeSplit(i, i + d);
             }
+
+            if (q == p)
+                break;
+
+            d = q - p;
+            q /= 2;
+            r = p;
         }
-        
-        queue.finish();
     }
 
-    queue.enqueueReadBuffer(buffer, CL_TRUE, 0, sizeof(int) * sequence.size(), sequence.data());
+    finishQueue(queue);
+}
+
+// How an external sort splits its host memory budget: two run buffers take
+// one half (one is filled while the other is sorted and spilled), the merge
+// takes the other half as one read block per input run plus the output block.
+struct ExternalPlan
+{
+    size_t runKeys;
+    size_t blockKeys;
+    size_t fanIn;
+};
+
+template <typename T>
+ExternalPlan planExternalSort(size_t budgetBytes)
+{
+    constexpr size_t maxFanIn = 256;
+
+    size_t halfKeys = budgetBytes / 2 / sizeof(T);
+
+    ExternalPlan plan;
+
+    plan.runKeys = std::max<size_t>(halfKeys / 2, 1);
+    plan.blockKeys = std::clamp<size_t>(halfKeys / 16, 1024, 1 << 18);
+    plan.fanIn = std::clamp<size_t>(halfKeys / plan.blockKeys, 3, maxFanIn + 1) - 1;
+
+    return plan;
 }
 
-void stdSort(std::vector<int>& sequence)
+// Sorts a sequence that does not fit in host memory. source(T*, n) fills up
+// to n keys and returns how many (0 at the end), sink(const T*, n) takes the
+// sorted keys block by block.
+//
+// Runs of plan.runKeys keys are sorted on the device and spilled as binary
+// files into a private directory under tempParent, the next run is read
+// while the current one is sorted. A background merger compacts every
+// plan.fanIn runs of the same level into one run of the next level as soon
+// as they exist, so merging overlaps run generation. The runs left at the
+// end are merged in passes of plan.fanIn, the last pass goes to sink. Input
+// that fits in one run never touches the disk.
+template <typename T, typename Source, typename Sink>
+size_t externalSort(Source&& source, Sink&& sink, const cl::Device& device, const std::string& kernelSource,
+                    const SortConfig& config, size_t budgetBytes, const std::filesystem::path& tempParent)
 {
-    std::sort(sequence.begin(), sequence.end());
+    ExternalPlan plan = planExternalSort<T>(budgetBytes);
+    size_t deviceBlock = deviceBlockSize<T>(device);
+
+    std::vector<T> current(plan.runKeys);
+    size_t got = source(current.data(), plan.runKeys);
+
+    if (got < plan.runKeys)
+    {
+        sortInBlocks(current.data(), got, device, kernelSource, config, deviceBlock);
+        sink(current.data(), got);
+        return got;
+    }
+
+    TempDir tempDir(tempParent);
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<std::deque<std::string>> levels(1);
+    size_t runsCreated = 0;
+    bool generating = true;
+    std::exception_ptr mergeError;
+
+    auto newRunPath = [&]
+    {
+        return (tempDir.path() / ("run" + std::to_string(runsCreated++) + ".bin")).string();
+    };
+
+    auto mergeInto = [&](const std::vector<std::string>& group, const std::string& path)
+    {
+        BinaryStreamWriter<T> writer(path, plan.blockKeys);
+
+        mergeRuns<T>(group, plan.blockKeys, [&](const T* keys, size_t n) { writer.append(keys, n); });
+
+        writer.finish(true);
+
+        for (const auto& run : group)
+            std::filesystem::remove(run);
+    };
+
+    std::thread merger([&]
+    {
+        try
+        {
+            while (true)
+            {
+                std::vector<std::string> group;
+                std::string path;
+                size_t level = 0;
+
+                {
+                    std::unique_lock lock(mutex);
+
+                    auto full = [&]
+                    {
+                        for (level = 0; level < levels.size(); ++level)
+                        {
+                            if (levels[level].size() >= plan.fanIn)
+                                return true;
+                        }
+
+                        return false;
+                    };
+
+                    changed.wait(lock, [&] { return full() || !generating; });
+
+                    if (!full())
+                        return;
+
+                    group.assign(levels[level].begin(), levels[level].begin() + plan.fanIn);
+                    levels[level].erase(levels[level].begin(), levels[level].begin() + plan.fanIn);
+                    path = newRunPath();
+                }
+
+                mergeInto(group, path);
+
+                std::lock_guard lock(mutex);
+
+                if (levels.size() == level + 1)
+                    levels.emplace_back();
+
+                levels[level + 1].push_back(path);
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard lock(mutex);
+            mergeError = std::current_exception();
+        }
+    });
+
+    auto stopMerger = [&]
+    {
+        {
+            std::lock_guard lock(mutex);
+            generating = false;
+            changed.notify_all();
+        }
+
+        merger.join();
+    };
+
+    size_t total = 0;
+
+    try
+    {
+        std::vector<T> next(plan.runKeys);
+
+        while (got > 0)
+        {
+            auto reading = std::async(std::launch::async, [&] { return source(next.data(), plan.runKeys); });
+
+            sortInBlocks(current.data(), got, device, kernelSource, config, deviceBlock);
+
+            std::string path;
+
+            {
+                std::lock_guard lock(mutex);
+                path = newRunPath();
+            }
+
+            writeBinary(path, current.data(), got, true);
+            total += got;
+
+            {
+                std::lock_guard lock(mutex);
+                levels[0].push_back(path);
+                changed.notify_all();
+            }
+
+            got = reading.get();
+            std::swap(current, next);
+        }
+    }
+    catch (...)
+    {
+        stopMerger();
+        throw;
+    }
+
+    stopMerger();
+
+    if (mergeError)
+        std::rethrow_exception(mergeError);
+
+    // Release the run buffers before the final passes take the merge half
+    std::vector<T>().swap(current);
+
+    std::deque<std::string> runs;
+
+    for (auto& level : levels)
+        runs.insert(runs.end(), level.begin(), level.end());
+
+    while (runs.size() > plan.fanIn)
+    {
+        std::vector<std::string> group(runs.begin(), runs.begin() + plan.fanIn);
+        runs.erase(runs.begin(), runs.begin() + plan.fanIn);
+
+        std::string path = newRunPath();
+        mergeInto(group, path);
+
+        runs.push_back(path);
+    }
+
+    mergeRuns<T>(std::vector<std::string>(runs.begin(), runs.end()), plan.blockKeys, sink);
+
+    return total;
 }
 
 std::string readKernel(std::string_view fileWithKernel) 
@@ -396,35 +1975,42 @@ std::string readKernel(std::string_view fileWithKernel)
 }
 
 
+// Parses "<count> v1 v2 ..." text after the header has been validated by the caller
+template <typename T>
+std::vector<T> parseSequence(std::string_view text, size_t n, size_t& items_read)
+{
+    std::vector<T> result(std::min(n, maxValuesIn(text)));
+
+    items_read = parseValues(text, result.data(), result.size());
+
+    return result;
+}
+
 template <typename T>
 std::vector<T> input_stdin()
 {
-    long long count = 0;
+    std::string input;
+    std::vector<char> chunk(1 << 20);
+
+    while (std::streamsize got = std::cin.rdbuf()->sgetn(chunk.data(), chunk.size()))
+        input.append(chunk.data(), got);
 
-    if (!(std::cin >> count)) {
-        std::cin.clear();
-        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    std::string_view text = input;
+
+    auto count = parseCountHeader(text);
+
+    if (!count) {
         throw std::runtime_error("Invalid input. Expected a number.");
     }
 
-    if (count < 0) {
-        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    if (*count < 0) {
         throw std::runtime_error("Number must be non-negative.");
     }
-
-    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-    
-    size_t n = static_cast<size_t>(count);
-    std::vector<T> result;
-    result.reserve(n);
     
-    T value;
+    size_t n = static_cast<size_t>(*count);
     size_t items_read = 0;
-    
-    while (items_read < n && std::cin >> value) {
-        result.push_back(value);
-        items_read++;
-    }
+
+    std::vector<T> result = parseSequence<T>(text, n, items_read);
     
     if (items_read != n) {
         throw std::runtime_error("Failed to read " + std::to_string(n) + 
@@ -438,33 +2024,24 @@ std::vector<T> input_stdin()
 template <typename T>
 std::vector<T> input_fstream(std::string_view fileName)
 {
-    std::ifstream inputFile(fileName.data());
+    MappedFile inputFile(fileName);
 
-    if (!inputFile.is_open()) {
-        throw std::runtime_error("Failed to open file: " + std::string(fileName));
-    }
+    std::string_view text = inputFile.view();
 
-    long long count = 0;
+    auto count = parseCountHeader(text);
     
-    if (!(inputFile >> count)) {
+    if (!count) {
         throw std::runtime_error("Invalid file format. Expected a number at the beginning.");
     }
 
-    if (count < 0) {
+    if (*count < 0) {
         throw std::runtime_error("Number of elements must be non-negative");
     }
     
-    size_t n = static_cast<size_t>(count);
-    std::vector<T> result;
-    result.reserve(n);
-    
-    T value;
+    size_t n = static_cast<size_t>(*count);
     size_t items_read = 0;
-    
-    while (items_read < n && inputFile >> value) {
-        result.push_back(value);
-        items_read++;
-    }
+
+    std::vector<T> result = parseSequence<T>(text, n, items_read);
     
     if (items_read != n) {
         throw std::runtime_error("File contains fewer numbers than specified. Expected: " + 
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string_view>
+
+namespace bs {
+
+// Process-wide counters of the hot paths, to check which paths a run took:
+// kernel launches by kind, bytes moved between host and device, queue
+// drains, program builds and device buffer allocations. The library only
+// counts when built with BS_COUNTERS defined (cmake -DBS_COUNTERS=ON),
+// otherwise count() compiles to nothing and every counter stays 0.
+enum class Counter
+{
+    LocalLaunches,
+    GlobalLaunches,
+    OtherLaunches,
+    UploadBytes,
+    DownloadBytes,
+    DeviceCopyBytes,
+    QueueFinishes,
+    ProgramBuilds,
+    BufferAllocations,
+    BufferBytes
+};
+
+constexpr size_t countersCount = 10;
+
+#ifdef BS_COUNTERS
+constexpr bool countersEnabled = true;
+#else
+constexpr bool countersEnabled = false;
+#endif
+
+std::string_view counterName(Counter counter)
+{
+    switch (counter)
+    {
+        case Counter::LocalLaunches:     return "local stage launches";
+        case Counter::GlobalLaunches:    return "global stage launches";
+        case Counter::OtherLaunches:     return "other kernel launches";
+        case Counter::UploadBytes:       return "bytes uploaded";
+        case Counter::DownloadBytes:     return "bytes downloaded";
+        case Counter::DeviceCopyBytes:   return "bytes copied on device";
+        case Counter::QueueFinishes:     return "queue finishes";
+        case Counter::ProgramBuilds:     return "program builds";
+        case Counter::BufferAllocations: return "buffer allocations";
+        case Counter::BufferBytes:       return "bytes allocated";
+    }
+
+    return "unknown";
+}
+
+// Relaxed atomics: the counters are only totals, they order nothing
+std::array<std::atomic<uint64_t>, countersCount>& counterValues()
+{
+    static std::array<std::atomic<uint64_t>, countersCount> values{};
+
+    return values;
+}
+
+void count(Counter counter, uint64_t amount = 1)
+{
+    if constexpr (countersEnabled)
+        counterValues()[static_cast<size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+}
+
+uint64_t counterValue(Counter counter)
+{
+    return counterValues()[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+}
+
+void resetCounters()
+{
+    for (auto& value : counterValues())
+        value.store(0, std::memory_order_relaxed);
+}
+
+// One "name value" line per counter
+void reportCounters(std::ostream& out)
+{
+    for (size_t i = 0; i < countersCount; ++i)
+    {
+        Counter counter = static_cast<Counter>(i);
+
+        out << std::left << std::setw(24) << counterName(counter) << std::right << std::setw(16)
+            << counterValue(counter) << '\n';
+    }
+}
+
+}; // namespace bs
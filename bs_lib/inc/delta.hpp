@@ -0,0 +1,343 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "parser.hpp"
+#include "binary.hpp"
+#include "writer.hpp"
+
+namespace bs {
+
+// Delta file: keys cut into blocks of blockSize, every block stores its first
+// key in the index and the differences to the previous key as zigzag LEB128
+// varints. Sorted keys give small non-negative differences, one or two bytes
+// each for dense data. The index also keeps the byte offset of every block,
+// so any block can be decoded on its own.
+//
+//   DeltaHeader | DeltaIndexEntry[blocksCount] | block payloads
+constexpr char     deltaMagic[4] = {'B', 'S', 'D', 'V'};
+constexpr uint16_t deltaVersion  = 1;
+
+struct DeltaHeader
+{
+    char     magic[4];
+    uint16_t version;
+    uint8_t  keyType;
+    uint8_t  reserved;
+    uint32_t blockSize;
+    uint32_t reserved2;
+    uint64_t count;
+    uint64_t blocksCount;
+};
+
+static_assert(sizeof(DeltaHeader) == 32);
+
+struct DeltaIndexEntry
+{
+    int64_t  firstKey;
+    uint64_t offset;    // from the start of the payload section
+};
+
+static_assert(sizeof(DeltaIndexEntry) == 16);
+
+uint64_t zigzagEncode(int64_t value)
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t zigzagDecode(uint64_t value)
+{
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+char* putVarint(char* out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+
+    *out++ = static_cast<char>(value);
+
+    return out;
+}
+
+const char* getVarint(const char* in, const char* end, uint64_t& value)
+{
+    value = 0;
+
+    for (int shift = 0; in < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = static_cast<uint8_t>(*in++);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+        if (!(byte & 0x80))
+            return in;
+    }
+
+    throw std::runtime_error("Truncated varint in delta file");
+}
+
+// Encodes the deltas of one block (everything after its first key) into out,
+// which must hold (n - 1) * 10 chars. Returns the number of chars written.
+template <typename T>
+size_t encodeDeltaBlock(const T* keys, size_t n, char* out)
+{
+    char* pos = out;
+
+    for (size_t i = 1; i < n; ++i)
+        pos = putVarint(pos, zigzagEncode(static_cast<int64_t>(keys[i]) - static_cast<int64_t>(keys[i - 1])));
+
+    return pos - out;
+}
+
+// Blocks are encoded in parallel, one contiguous range of blocks per
+// hardware thread, and written behind the index with a single writev.
+template <typename T>
+void writeDelta(std::string_view fileName, const T* keys, size_t count, uint32_t blockSize = 4096)
+{
+    constexpr size_t maxVarint = 10;
+
+    size_t blocksCount = (count + blockSize - 1) / blockSize;
+
+    size_t threadsCount = std::max(1u, std::thread::hardware_concurrency());
+    threadsCount = std::clamp<size_t>(blocksCount / 16, 1, threadsCount);
+
+    size_t blocksPerThread = (blocksCount + threadsCount - 1) / threadsCount;
+
+    std::vector<DeltaIndexEntry> index(blocksCount);
+    std::vector<std::vector<char>> payloads(threadsCount);
+
+    auto encode = [&](size_t t)
+    {
+        size_t firstBlock = std::min(blocksCount, t * blocksPerThread);
+        size_t lastBlock = std::min(blocksCount, firstBlock + blocksPerThread);
+
+        std::vector<char>& payload = payloads[t];
+        std::vector<char> scratch(blockSize * maxVarint);
+
+        for (size_t block = firstBlock; block < lastBlock; ++block)
+        {
+            size_t begin = block * blockSize;
+            size_t n = std::min<size_t>(blockSize, count - begin);
+
+            index[block].firstKey = keys[begin];
+            index[block].offset = payload.size();
+
+            size_t size = encodeDeltaBlock(keys + begin, n, scratch.data());
+            payload.insert(payload.end(), scratch.data(), scratch.data() + size);
+        }
+    };
+
+    if (threadsCount == 1)
+    {
+        encode(0);
+    }
+    else
+    {
+        std::vector<std::thread> threads;
+        threads.reserve(threadsCount);
+
+        for (size_t t = 0; t < threadsCount; ++t)
+            threads.emplace_back(encode, t);
+
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    // Offsets were relative to the thread's own payload
+    size_t base = 0;
+
+    for (size_t t = 0; t < threadsCount; ++t)
+    {
+        size_t firstBlock = std::min(blocksCount, t * blocksPerThread);
+        size_t lastBlock = std::min(blocksCount, firstBlock + blocksPerThread);
+
+        for (size_t block = firstBlock; block < lastBlock; ++block)
+            index[block].offset += base;
+
+        base += payloads[t].size();
+    }
+
+    DeltaHeader header{};
+
+    std::memcpy(header.magic, deltaMagic, sizeof(deltaMagic));
+    header.version     = deltaVersion;
+    header.keyType     = static_cast<uint8_t>(keyTypeOf<T>());
+    header.blockSize   = blockSize;
+    header.count       = count;
+    header.blocksCount = blocksCount;
+
+    int fd = ::open(std::string(fileName).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0)
+        throw std::runtime_error("Failed to create file: " + std::string(fileName));
+
+    std::vector<iovec> parts;
+    parts.push_back({&header, sizeof(header)});
+    parts.push_back({index.data(), sizeof(DeltaIndexEntry) * index.size()});
+
+    for (auto& payload : payloads)
+        parts.push_back({payload.data(), payload.size()});
+
+    try
+    {
+        writeAll(fd, parts);
+    }
+    catch (...)
+    {
+        ::close(fd);
+        throw;
+    }
+
+    ::close(fd);
+}
+
+// Memory-mapped delta file, blocks are decoded on demand
+class DeltaReader
+{
+    MappedFile             file;
+    DeltaHeader            header;
+    const DeltaIndexEntry* index = nullptr;
+    const char*            payload = nullptr;
+    size_t                 payloadSize = 0;
+
+public:
+    explicit DeltaReader(std::string_view fileName)
+        : file(fileName)
+    {
+        if (file.size() < sizeof(DeltaHeader))
+            throw std::runtime_error("Delta file is too short for a header: " + std::string(fileName));
+
+        std::memcpy(&header, file.data(), sizeof(DeltaHeader));
+
+        if (std::memcmp(header.magic, deltaMagic, sizeof(deltaMagic)) != 0)
+            throw std::runtime_error("Not a delta file: " + std::string(fileName));
+
+        if (header.version != deltaVersion)
+            throw std::runtime_error("Unsupported delta file version: " + std::to_string(header.version));
+
+        if (header.keyType != static_cast<uint8_t>(KeyType::Int32))
+            throw std::runtime_error("Unsupported key type in delta file: " + std::to_string(header.keyType));
+
+        if (header.blockSize == 0 || header.blocksCount != (header.count + header.blockSize - 1) / header.blockSize)
+            throw std::runtime_error("Delta file header is inconsistent: " + std::string(fileName));
+
+        size_t indexSize = sizeof(DeltaIndexEntry) * header.blocksCount;
+
+        if (file.size() - sizeof(DeltaHeader) < indexSize)
+            throw std::runtime_error("Delta file is too short for its index: " + std::string(fileName));
+
+        index = reinterpret_cast<const DeltaIndexEntry*>(file.data() + sizeof(DeltaHeader));
+        payload = file.data() + sizeof(DeltaHeader) + indexSize;
+        payloadSize = file.size() - sizeof(DeltaHeader) - indexSize;
+
+        for (size_t block = 0; block < header.blocksCount; ++block)
+        {
+            if (index[block].offset > payloadSize || (block > 0 && index[block].offset < index[block - 1].offset))
+                throw std::runtime_error("Delta file index is corrupted: " + std::string(fileName));
+        }
+    }
+
+    size_t count() const { return header.count; }
+    size_t blockSize() const { return header.blockSize; }
+    size_t blocksCount() const { return header.blocksCount; }
+
+    // Decodes one block into out and returns the number of keys in it
+    template <typename T>
+    size_t decodeBlock(size_t block, T* out) const
+    {
+        size_t begin = block * header.blockSize;
+        size_t n = std::min<size_t>(header.blockSize, header.count - begin);
+
+        const char* pos = payload + index[block].offset;
+        const char* end = (block + 1 < header.blocksCount) ? payload + index[block + 1].offset : payload + payloadSize;
+
+        int64_t key = index[block].firstKey;
+        out[0] = static_cast<T>(key);
+
+        for (size_t i = 1; i < n; ++i)
+        {
+            uint64_t delta;
+            pos = getVarint(pos, end, delta);
+
+            key += zigzagDecode(delta);
+            out[i] = static_cast<T>(key);
+        }
+
+        return n;
+    }
+
+    // Decodes all blocks, spread round-robin over the hardware threads
+    template <typename T>
+    std::vector<T> decode() const
+    {
+        std::vector<T> result(header.count);
+
+        size_t threadsCount = std::max(1u, std::thread::hardware_concurrency());
+        threadsCount = std::clamp<size_t>(header.blocksCount / 16, 1, threadsCount);
+
+        std::vector<std::thread> threads;
+        std::vector<std::exception_ptr> errors(threadsCount);
+
+        auto work = [&](size_t t)
+        {
+            try
+            {
+                for (size_t block = t; block < header.blocksCount; block += threadsCount)
+                    decodeBlock(block, result.data() + block * header.blockSize);
+            }
+            catch (...)
+            {
+                errors[t] = std::current_exception();
+            }
+        };
+
+        for (size_t t = 1; t < threadsCount; ++t)
+            threads.emplace_back(work, t);
+
+        work(0);
+
+        for (auto& thread : threads)
+            thread.join();
+
+        for (auto& error : errors)
+        {
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+        return result;
+    }
+};
+
+bool isDeltaFile(std::string_view fileName)
+{
+    int fd = ::open(std::string(fileName).c_str(), O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    char magic[sizeof(deltaMagic)];
+    bool matches = ::read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+                   std::memcmp(magic, deltaMagic, sizeof(magic)) == 0;
+
+    ::close(fd);
+
+    return matches;
+}
+
+}; // namespace bs
@@ -0,0 +1,327 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "parser.hpp"
+
+namespace bs {
+
+// NumPy .npy file: magic, format version, header length (16-bit in version
+// 1, 32-bit in 2 and 3) and a Python dict literal with descr, fortran_order
+// and shape, padded with spaces so the data that follows is aligned.
+// One-dimensional little-endian arrays of the dtypes below are supported.
+constexpr char npyMagic[6] = {'\x93', 'N', 'U', 'M', 'P', 'Y'};
+
+enum class NpyDtype
+{
+    Int32,
+    Int64,
+    UInt32,
+    Float32,
+    Float64
+};
+
+NpyDtype parseNpyDtype(std::string_view descr)
+{
+    if (descr == "<i4")
+        return NpyDtype::Int32;
+
+    if (descr == "<i8")
+        return NpyDtype::Int64;
+
+    if (descr == "<u4")
+        return NpyDtype::UInt32;
+
+    if (descr == "<f4")
+        return NpyDtype::Float32;
+
+    if (descr == "<f8")
+        return NpyDtype::Float64;
+
+    throw std::invalid_argument("Unsupported .npy dtype: " + std::string(descr) +
+                                ". Expected <i4, <i8, <u4, <f4 or <f8");
+}
+
+template <typename T>
+constexpr NpyDtype npyDtypeOf()
+{
+    if constexpr (std::is_same_v<T, int32_t>)
+        return NpyDtype::Int32;
+    else if constexpr (std::is_same_v<T, int64_t>)
+        return NpyDtype::Int64;
+    else if constexpr (std::is_same_v<T, uint32_t>)
+        return NpyDtype::UInt32;
+    else if constexpr (std::is_same_v<T, float>)
+        return NpyDtype::Float32;
+    else if constexpr (std::is_same_v<T, double>)
+        return NpyDtype::Float64;
+    else
+        static_assert(!std::is_same_v<T, T>, "No .npy dtype for this key type");
+}
+
+std::string_view npyDescr(NpyDtype dtype)
+{
+    switch (dtype)
+    {
+        case NpyDtype::Int32:   return "<i4";
+        case NpyDtype::Int64:   return "<i8";
+        case NpyDtype::UInt32:  return "<u4";
+        case NpyDtype::Float32: return "<f4";
+        case NpyDtype::Float64: return "<f8";
+    }
+
+    throw std::invalid_argument("Unknown .npy dtype");
+}
+
+size_t npyDtypeSize(NpyDtype dtype)
+{
+    return (dtype == NpyDtype::Int64 || dtype == NpyDtype::Float64) ? 8 : 4;
+}
+
+// Calls f(std::type_identity<T>{}) with the key type stored as dtype, so
+// the caller instantiates its typed path once per supported dtype
+template <typename F>
+decltype(auto) dispatchNpyDtype(NpyDtype dtype, F&& f)
+{
+    switch (dtype)
+    {
+        case NpyDtype::Int32:   return f(std::type_identity<int32_t>{});
+        case NpyDtype::Int64:   return f(std::type_identity<int64_t>{});
+        case NpyDtype::UInt32:  return f(std::type_identity<uint32_t>{});
+        case NpyDtype::Float32: return f(std::type_identity<float>{});
+        case NpyDtype::Float64: return f(std::type_identity<double>{});
+    }
+
+    throw std::invalid_argument("Unknown .npy dtype");
+}
+
+// Regular files only, as in isBinaryFile()
+bool isNpyFile(std::string_view fileName)
+{
+    struct stat st;
+
+    if (::stat(std::string(fileName).c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+
+    int fd = ::open(std::string(fileName).c_str(), O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    char magic[sizeof(npyMagic)];
+    bool matches = ::read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+                   std::memcmp(magic, npyMagic, sizeof(magic)) == 0;
+
+    ::close(fd);
+
+    return matches;
+}
+
+struct NpyHeader
+{
+    NpyDtype dtype;
+    size_t   count;
+    size_t   dataOffset;
+};
+
+// Text after "'key':" in the header dict, with leading spaces removed
+std::optional<std::string_view> npyDictValue(std::string_view dict, std::string_view key)
+{
+    size_t pos = dict.find("'" + std::string(key) + "'");
+
+    if (pos == std::string_view::npos)
+        return std::nullopt;
+
+    pos = dict.find(':', pos + key.size() + 2);
+
+    if (pos == std::string_view::npos)
+        return std::nullopt;
+
+    std::string_view value = dict.substr(pos + 1);
+
+    while (!value.empty() && isSpace(value.front()))
+        value.remove_prefix(1);
+
+    return value;
+}
+
+NpyHeader parseNpyHeader(std::string_view file, std::string_view fileName)
+{
+    if (file.size() < 10 || std::memcmp(file.data(), npyMagic, sizeof(npyMagic)) != 0)
+        throw std::runtime_error("Not a .npy file: " + std::string(fileName));
+
+    uint8_t major = static_cast<uint8_t>(file[6]);
+
+    if (major < 1 || major > 3)
+        throw std::runtime_error("Unsupported .npy format version: " + std::to_string(major));
+
+    size_t lengthSize = (major == 1) ? 2 : 4;
+
+    if (file.size() < 8 + lengthSize)
+        throw std::runtime_error(".npy file is too short for a header: " + std::string(fileName));
+
+    uint32_t headerLength = 0;
+    std::memcpy(&headerLength, file.data() + 8, lengthSize);
+
+    size_t dataOffset = 8 + lengthSize + headerLength;
+
+    if (file.size() < dataOffset)
+        throw std::runtime_error(".npy file is too short for its header: " + std::string(fileName));
+
+    std::string_view dict = file.substr(8 + lengthSize, headerLength);
+
+    auto descr = npyDictValue(dict, "descr");
+    auto fortranOrder = npyDictValue(dict, "fortran_order");
+    auto shape = npyDictValue(dict, "shape");
+
+    if (!descr || !fortranOrder || !shape || descr->empty() || shape->empty() || shape->front() != '(')
+        throw std::runtime_error(".npy header is malformed: " + std::string(fileName));
+
+    char quote = descr->front();
+    size_t descrEnd = descr->find(quote, 1);
+
+    if ((quote != '\'' && quote != '"') || descrEnd == std::string_view::npos)
+        throw std::runtime_error(".npy header is malformed: " + std::string(fileName));
+
+    NpyHeader header;
+    header.dtype = parseNpyDtype(descr->substr(1, descrEnd - 1));
+    header.dataOffset = dataOffset;
+
+    // A one-dimensional shape reads "(count,)", fortran_order does not
+    // matter for it
+    std::string_view dims = shape->substr(1, shape->find(')') - 1);
+    long long count = 0;
+
+    if (!parseToken(dims, count) || count < 0 || dims.empty() || dims.front() != ',' ||
+        dims.substr(1).find_first_not_of(" ") != std::string_view::npos)
+    {
+        throw std::runtime_error("Only one-dimensional .npy arrays can be sorted: " + std::string(fileName));
+    }
+
+    header.count = static_cast<size_t>(count);
+
+    return header;
+}
+
+// Version 1 header for a one-dimensional array of count keys, padded with
+// spaces so the data starts on a 64 byte boundary
+std::string makeNpyHeader(NpyDtype dtype, size_t count)
+{
+    std::string dict = "{'descr': '" + std::string(npyDescr(dtype)) + "', 'fortran_order': False, 'shape': (" +
+                       std::to_string(count) + ",), }";
+
+    size_t unpadded = 10 + dict.size() + 1;
+    dict.append((64 - unpadded % 64) % 64, ' ');
+    dict.push_back('\n');
+
+    uint16_t headerLength = static_cast<uint16_t>(dict.size());
+
+    std::string header(npyMagic, sizeof(npyMagic));
+    header.push_back('\x01');
+    header.push_back('\x00');
+    header.append(reinterpret_cast<const char*>(&headerLength), sizeof(headerLength));
+
+    return header + dict;
+}
+
+// Memory-mapped .npy file, the keys are used straight from the mapping
+class NpyReader
+{
+    MappedFile file;
+    NpyHeader  header;
+
+public:
+    explicit NpyReader(std::string_view fileName)
+        : file(fileName), header(parseNpyHeader(file.view(), fileName))
+    {
+        if (file.size() - header.dataOffset != npyDtypeSize(header.dtype) * header.count)
+            throw std::runtime_error(".npy file size does not match its shape. Expected: " +
+                                     std::to_string(header.count) + " keys");
+
+        // The kernels compare keys with < and >, NaN is unordered against
+        // every key and the padding and would come back out of place
+        dispatchNpyDtype(header.dtype, [&]<typename T>(std::type_identity<T>)
+        {
+            if constexpr (std::is_floating_point_v<T>)
+            {
+                const T* first = keys<T>();
+                const T* nan = std::find_if(first, first + header.count, [](T key) { return std::isnan(key); });
+
+                if (nan != first + header.count)
+                    throw std::runtime_error(".npy file holds NaN at index " + std::to_string(nan - first) +
+                                             ", NaN keys cannot be sorted");
+            }
+        });
+    }
+
+    NpyDtype dtype() const { return header.dtype; }
+    size_t count() const { return header.count; }
+
+    template <typename T>
+    const T* keys() const
+    {
+        if (npyDtypeOf<T>() != header.dtype)
+            throw std::runtime_error(".npy file holds a different dtype");
+
+        if (header.dataOffset % alignof(T) != 0)
+            throw std::runtime_error(".npy data is not aligned for its dtype");
+
+        return reinterpret_cast<const T*>(file.data() + header.dataOffset);
+    }
+};
+
+// Creates a .npy file of count keys with its header written up front and
+// maps it for writing, keys() is filled by the caller (e.g. read back from
+// the device straight into it)
+template <typename T>
+class NpyWriter
+{
+    std::optional<MappedFile> file;
+    size_t dataOffset;
+
+public:
+    NpyWriter(std::string_view fileName, size_t count)
+    {
+        std::string header = makeNpyHeader(npyDtypeOf<T>(), count);
+        dataOffset = header.size();
+
+        int fd = ::open(std::string(fileName).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+        if (fd < 0)
+            throw std::runtime_error("Failed to create file: " + std::string(fileName));
+
+        bool written = ::ftruncate(fd, header.size() + sizeof(T) * count) == 0 &&
+                       ::pwrite(fd, header.data(), header.size(), 0) == static_cast<ssize_t>(header.size());
+
+        ::close(fd);
+
+        if (!written)
+            throw std::runtime_error("Failed to write file: " + std::string(fileName));
+
+        file.emplace(fileName, true);
+    }
+
+    T* keys() { return reinterpret_cast<T*>(file->data() + dataOffset); }
+};
+
+template <typename T>
+void writeNpy(std::string_view fileName, const T* keys, size_t count)
+{
+    NpyWriter<T> writer(fileName, count);
+
+    std::copy_n(keys, count, writer.keys());
+}
+
+}; // namespace bs
@@ -0,0 +1,367 @@
+#pragma once
+
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <optional>
+#include <streambuf>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace bs {
+
+// Read-only (or read-write) memory mapping of a whole file. Pipes, FIFOs
+// and /dev/stdin have no size to map, they are read into a buffer instead.
+class MappedFile
+{
+    int    fd   = -1;
+    char*  data_ = nullptr;
+    size_t size_ = 0;
+    std::vector<char> buffer;
+
+public:
+    explicit MappedFile(std::string_view fileName, bool writable = false)
+    {
+        fd = ::open(std::string(fileName).c_str(), writable ? O_RDWR : O_RDONLY);
+
+        if (fd < 0)
+            throw std::runtime_error("Failed to open file: " + std::string(fileName));
+
+        struct stat st;
+
+        if (::fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Failed to stat file: " + std::string(fileName));
+        }
+
+        if (!S_ISREG(st.st_mode))
+        {
+            if (writable)
+            {
+                ::close(fd);
+                throw std::runtime_error("Failed to map file: " + std::string(fileName));
+            }
+
+            readAll(fileName);
+            return;
+        }
+
+        size_ = static_cast<size_t>(st.st_size);
+
+        if (size_ == 0)
+            return;
+
+        int protection = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+        void* mapping = ::mmap(nullptr, size_, protection, MAP_SHARED, fd, 0);
+
+        if (mapping == MAP_FAILED)
+        {
+            ::close(fd);
+            throw std::runtime_error("Failed to map file: " + std::string(fileName));
+        }
+
+        data_ = static_cast<char*>(mapping);
+
+        ::madvise(data_, size_, MADV_SEQUENTIAL);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        if (data_ && buffer.empty())
+            ::munmap(data_, size_);
+
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    std::string_view view() const { return {data_, size_}; }
+
+private:
+    void readAll(std::string_view fileName)
+    {
+        constexpr size_t readSize = size_t(1) << 20;
+
+        for (;;)
+        {
+            buffer.resize(size_ + readSize);
+
+            ssize_t bytes = ::read(fd, buffer.data() + size_, readSize);
+
+            if (bytes < 0 && errno == EINTR)
+                continue;
+
+            if (bytes < 0)
+            {
+                ::close(fd);
+                throw std::runtime_error("Failed to read file: " + std::string(fileName));
+            }
+
+            if (bytes == 0)
+                break;
+
+            size_ += static_cast<size_t>(bytes);
+        }
+
+        buffer.resize(size_);
+
+        if (size_ > 0)
+            data_ = buffer.data();
+    }
+};
+
+bool isSpace(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Parses one whitespace-delimited token at the front of text into value and
+// advances text past it. Same acceptance as operator>>: an optional '+' is
+// allowed and a token like "12abc" yields 12, leaving "abc" as the next token.
+template <typename T>
+bool parseToken(std::string_view& text, T& value)
+{
+    size_t pos = 0;
+
+    while (pos < text.size() && isSpace(text[pos]))
+        ++pos;
+
+    if (pos == text.size())
+        return false;
+
+    if (text[pos] == '+' && pos + 1 < text.size() && text[pos + 1] != '-')
+        ++pos;
+
+    auto [ptr, ec] = std::from_chars(text.data() + pos, text.data() + text.size(), value);
+
+    if (ec != std::errc())
+        return false;
+
+    text.remove_prefix(ptr - text.data());
+
+    return true;
+}
+
+// Count header of the text formats, text is advanced past it
+std::optional<long long> parseCountHeader(std::string_view& text)
+{
+    long long count = 0;
+
+    if (!parseToken(text, count))
+        return std::nullopt;
+
+    return count;
+}
+
+size_t countTokens(std::string_view text)
+{
+    size_t tokens = 0;
+    bool inToken = false;
+
+    for (char c : text)
+    {
+        bool space = isSpace(c);
+        tokens += (!space && !inToken);
+        inToken = !space;
+    }
+
+    return tokens;
+}
+
+// Parses up to n values from text into out and returns how many were read
+// before the end of text or the first token that is not a number. Large
+// inputs are split at whitespace into one chunk per hardware thread: the
+// first pass counts the tokens of every chunk, which gives each chunk its
+// output offset, the second pass parses all chunks in place concurrently.
+template <typename T>
+size_t parseValues(std::string_view text, T* out, size_t n)
+{
+    constexpr size_t parallelThreshold = 1 << 20;
+
+    size_t threadsCount = std::max(1u, std::thread::hardware_concurrency());
+
+    if (text.size() < parallelThreshold)
+        threadsCount = 1;
+
+    std::vector<std::string_view> chunks;
+    chunks.reserve(threadsCount);
+
+    size_t begin = 0;
+
+    for (size_t i = 1; i <= threadsCount; ++i)
+    {
+        size_t end = (i == threadsCount) ? text.size() : std::max(begin, text.size() / threadsCount * i);
+
+        while (end < text.size() && !isSpace(text[end]))
+            ++end;
+
+        chunks.push_back(text.substr(begin, end - begin));
+        begin = end;
+    }
+
+    std::vector<size_t> offsets(chunks.size() + 1, 0);
+    std::vector<size_t> parsed(chunks.size(), 0);
+
+    auto forEachChunk = [&](auto&& work)
+    {
+        if (chunks.size() == 1)
+        {
+            work(0);
+            return;
+        }
+
+        std::vector<std::thread> threads;
+        threads.reserve(chunks.size());
+
+        for (size_t i = 0; i < chunks.size(); ++i)
+            threads.emplace_back(work, i);
+
+        for (auto& thread : threads)
+            thread.join();
+    };
+
+    if (chunks.size() > 1)
+    {
+        forEachChunk([&](size_t i) { offsets[i + 1] = countTokens(chunks[i]); });
+
+        for (size_t i = 0; i < chunks.size(); ++i)
+            offsets[i + 1] += offsets[i];
+    }
+    else
+    {
+        offsets[1] = n;
+    }
+
+    forEachChunk([&](size_t i)
+    {
+        std::string_view chunk = chunks[i];
+
+        for (size_t idx = offsets[i]; idx < std::min(offsets[i + 1], n); ++idx, ++parsed[i])
+        {
+            if (!parseToken(chunk, out[idx]))
+                break;
+        }
+    });
+
+    size_t itemsRead = 0;
+
+    for (size_t i = 0; i < chunks.size() && itemsRead < n; ++i)
+    {
+        itemsRead += parsed[i];
+
+        if (offsets[i] + parsed[i] < std::min(offsets[i + 1], n))
+            break;
+    }
+
+    return std::min(itemsRead, n);
+}
+
+// Values can not be denser than one digit and one separator each, so a
+// header claiming more than that is clamped before allocating
+size_t maxValuesIn(std::string_view text)
+{
+    return text.size() / 2 + 1;
+}
+
+// Pulls number tokens from a stream block by block, for inputs that are
+// consumed while they are still being produced (a pipe into biton). A token
+// split between two blocks is carried over to the next one.
+template <typename T>
+class StreamParser
+{
+    std::streambuf*  source;
+    std::string      pending;
+    std::string_view text;
+    bool             eof = false;
+    size_t           itemsRead_ = 0;
+
+    static constexpr size_t blockSize = 1 << 20;
+
+    bool refill()
+    {
+        if (eof)
+            return false;
+
+        size_t consumed = text.data() ? text.data() - pending.data() : 0;
+        pending.erase(0, consumed);
+
+        size_t kept = pending.size();
+        pending.resize(kept + blockSize);
+
+        std::streamsize got = source->sgetn(pending.data() + kept, blockSize);
+        pending.resize(kept + got);
+
+        eof = (got == 0);
+
+        size_t complete = pending.size();
+
+        if (!eof)
+        {
+            while (complete > 0 && !isSpace(pending[complete - 1]))
+                --complete;
+        }
+
+        text = std::string_view(pending).substr(0, complete);
+
+        return true;
+    }
+
+public:
+    explicit StreamParser(std::streambuf* source)
+        : source(source)
+    {}
+
+    // Parses up to n values into out. Returns how many were parsed, fewer
+    // than n only at the end of the stream. U other than T reads a value of
+    // another type, e.g. a 64-bit count header in front of int keys.
+    template <typename U = T>
+    size_t next(U* out, size_t n)
+    {
+        size_t parsed = 0;
+
+        while (parsed < n)
+        {
+            size_t pos = 0;
+
+            while (pos < text.size() && isSpace(text[pos]))
+                ++pos;
+
+            text.remove_prefix(pos);
+
+            if (text.empty())
+            {
+                if (!refill())
+                    break;
+
+                continue;
+            }
+
+            if (!parseToken(text, out[parsed]))
+                throw std::runtime_error("Invalid input. Expected a number after " +
+                                         std::to_string(itemsRead_) + " numbers.");
+
+            ++parsed;
+            ++itemsRead_;
+        }
+
+        return parsed;
+    }
+
+    size_t itemsRead() const { return itemsRead_; }
+};
+
+}; // namespace bs
@@ -0,0 +1,472 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "opencl.hpp"
+#include "counters.hpp"
+
+namespace bs {
+
+// What a profiled command spends its time on
+enum class ProfileKind
+{
+    Build,
+    Upload,
+    Download,
+    DeviceCopy,
+    LocalStage,
+    GlobalStage,
+    Kernel,
+    Host
+};
+
+constexpr size_t profileKindsCount = 8;
+
+std::string_view profileKindName(ProfileKind kind)
+{
+    switch (kind)
+    {
+        case ProfileKind::Build:       return "build";
+        case ProfileKind::Upload:      return "upload";
+        case ProfileKind::Download:    return "download";
+        case ProfileKind::DeviceCopy:  return "copy";
+        case ProfileKind::LocalStage:  return "local";
+        case ProfileKind::GlobalStage: return "global";
+        case ProfileKind::Kernel:      return "kernel";
+        case ProfileKind::Host:        return "host";
+    }
+
+    return "unknown";
+}
+
+// Host clock of the profile in nanoseconds
+uint64_t hostNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// JSON string literal of text, for the trace and benchmark files
+std::string jsonString(std::string_view text)
+{
+    std::string quoted = "\"";
+
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            quoted += '\\';
+            quoted += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            quoted += escaped;
+        }
+        else
+            quoted += c;
+    }
+
+    return quoted + "\"";
+}
+
+// Timeline of one or more sorts. Every transfer and kernel launch gets an
+// event of a queue created with CL_QUEUE_PROFILING_ENABLE, its device time
+// is read from CL_PROFILING_COMMAND_START/END once the command completed.
+// Program builds and the host phases around the sort (parse, pad, write)
+// are timed on the host. Records may be added from several threads.
+class Profile
+{
+public:
+    struct Record
+    {
+        ProfileKind      kind = ProfileKind::Kernel;
+        std::string      name;
+        size_t           stage = 0;        // network stage of a launch, 0 if it has none
+        size_t           subStage = 0;     // stride of a global substage launch
+        size_t           bytes = 0;        // bytes of a transfer, global memory a kernel reads and writes
+        cl::Event        event;            // device commands
+        cl_command_queue queue = nullptr;  // queue of a device command
+        uint64_t         hostStart = 0;    // host spans, or when a command was enqueued
+        uint64_t         hostEnd = 0;
+        std::thread::id  thread;
+        bool             onHost = false;
+    };
+
+private:
+    std::deque<Record> records_;
+    mutable std::mutex mutex;
+
+public:
+    // Event slot for a command about to be enqueued on queue, stays valid
+    // while more records are added
+    cl::Event* command(const cl::CommandQueue& queue, ProfileKind kind, std::string_view name,
+                       size_t stage = 0, size_t bytes = 0, size_t subStage = 0)
+    {
+        std::lock_guard lock(mutex);
+
+        Record& record = records_.emplace_back();
+        record.kind = kind;
+        record.name = name;
+        record.stage = stage;
+        record.subStage = subStage;
+        record.bytes = bytes;
+        record.queue = queue();
+        record.hostStart = hostNow();
+        record.thread = std::this_thread::get_id();
+
+        return &record.event;
+    }
+
+    void host(ProfileKind kind, std::string_view name, uint64_t start, uint64_t end)
+    {
+        std::lock_guard lock(mutex);
+
+        Record& record = records_.emplace_back();
+        record.kind = kind;
+        record.name = name;
+        record.hostStart = start;
+        record.hostEnd = end;
+        record.thread = std::this_thread::get_id();
+        record.onHost = true;
+    }
+
+    const std::deque<Record>& records() const { return records_; }
+
+    static double seconds(const Record& record)
+    {
+        if (record.onHost)
+            return (record.hostEnd - record.hostStart) * 1e-9;
+
+        cl_ulong start = record.event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+        cl_ulong end = record.event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+
+        return (end - start) * 1e-9;
+    }
+
+    // Seconds from the start of the first device command to the end of the
+    // last one, gaps between commands included. The commands share the clock
+    // of one device.
+    double deviceSpan() const
+    {
+        std::lock_guard lock(mutex);
+
+        cl_ulong first = UINT64_MAX;
+        cl_ulong last = 0;
+
+        for (const auto& record : records_)
+        {
+            if (record.onHost)
+                continue;
+
+            first = std::min(first, record.event.getProfilingInfo<CL_PROFILING_COMMAND_START>());
+            last = std::max(last, record.event.getProfilingInfo<CL_PROFILING_COMMAND_END>());
+        }
+
+        return last > first ? (last - first) * 1e-9 : 0;
+    }
+
+    // One row per stage and kind (launches of a stage summed) or per named
+    // command, in order of first appearance, then the totals of transfers,
+    // global stages, local stages, other kernels, builds and host phases
+    void report(std::ostream& out) const;
+
+    // Chrome trace event file (chrome://tracing, Perfetto): one track per
+    // host thread and one per queue. Device timestamps are moved onto the
+    // host clock per queue: a command is queued no earlier than the host
+    // enqueued it, the largest (enqueued - CL_PROFILING_COMMAND_QUEUED) of a
+    // queue is taken as its clock offset.
+    void writeTrace(std::ostream& out) const;
+
+    // Bandwidth every kernel and device copy achieves as a share of peak
+    // (bytes per second): one row per global substage stride, local stage
+    // or named command, in order of first appearance
+    void roofline(std::ostream& out, double peak) const;
+};
+
+void Profile::report(std::ostream& out) const
+{
+    std::lock_guard lock(mutex);
+
+    struct Row
+    {
+        std::string label;
+        ProfileKind kind;
+        size_t      count = 0;
+        size_t      bytes = 0;
+        double      seconds = 0;
+    };
+
+    std::vector<Row> rows;
+    double totals[profileKindsCount] = {};
+    double total = 0;
+
+    for (const auto& record : records_)
+    {
+        std::string label = record.stage ? "stage 2^" + std::to_string(std::countr_zero(record.stage)) : record.name;
+
+        auto row = std::find_if(rows.begin(), rows.end(), [&](const Row& row)
+        {
+            return row.label == label && row.kind == record.kind;
+        });
+
+        if (row == rows.end())
+            row = rows.insert(rows.end(), Row{label, record.kind});
+
+        double seconds = Profile::seconds(record);
+
+        row->count += 1;
+        row->bytes += record.bytes;
+        row->seconds += seconds;
+
+        totals[static_cast<size_t>(record.kind)] += seconds;
+        total += seconds;
+    }
+
+    auto share = [total](double seconds) { return total > 0 ? 100 * seconds / total : 0.0; };
+
+    out << std::left << std::setw(24) << "command" << std::setw(8) << "kind" << std::right
+        << std::setw(10) << "launches" << std::setw(12) << "ms" << std::setw(8) << "%" << std::setw(10) << "GB/s" << '\n';
+
+    out << std::fixed;
+
+    for (const auto& row : rows)
+    {
+        out << std::left << std::setw(24) << row.label << std::setw(8) << profileKindName(row.kind) << std::right
+            << std::setw(10) << row.count << std::setprecision(3) << std::setw(12) << row.seconds * 1e3
+            << std::setprecision(1) << std::setw(8) << share(row.seconds);
+
+        if (row.bytes > 0 && row.seconds > 0)
+            out << std::setprecision(2) << std::setw(10) << row.bytes / row.seconds / 1e9;
+
+        out << '\n';
+    }
+
+    auto kindTotal = [&](ProfileKind kind) { return totals[static_cast<size_t>(kind)]; };
+
+    double transfer = kindTotal(ProfileKind::Upload) + kindTotal(ProfileKind::Download) + kindTotal(ProfileKind::DeviceCopy);
+
+    std::pair<std::string_view, double> summary[] = {
+        {"transfers", transfer},
+        {"global stages", kindTotal(ProfileKind::GlobalStage)},
+        {"local stages", kindTotal(ProfileKind::LocalStage)},
+        {"other kernels", kindTotal(ProfileKind::Kernel)},
+        {"program builds", kindTotal(ProfileKind::Build)},
+        {"host phases", kindTotal(ProfileKind::Host)},
+        {"total", total},
+    };
+
+    out << '\n';
+
+    for (const auto& [name, seconds] : summary)
+        out << std::left << std::setw(24) << name << std::right << std::setprecision(3) << std::setw(30) << seconds * 1e3
+            << std::setprecision(1) << std::setw(8) << share(seconds) << '\n';
+
+    out << std::defaultfloat;
+}
+
+void Profile::writeTrace(std::ostream& out) const
+{
+    std::lock_guard lock(mutex);
+
+    // Host threads are tracks 1, 2, ..., queues 1001, 1002, ... in order of
+    // first appearance
+    std::map<std::thread::id, size_t> threads;
+    std::map<cl_command_queue, size_t> queues;
+    std::map<cl_command_queue, int64_t> offsets;
+    uint64_t origin = UINT64_MAX;
+
+    for (const auto& record : records_)
+    {
+        origin = std::min(origin, record.hostStart);
+
+        if (record.onHost)
+        {
+            threads.emplace(record.thread, threads.size() + 1);
+            continue;
+        }
+
+        queues.emplace(record.queue, queues.size() + 1001);
+
+        int64_t offset = static_cast<int64_t>(record.hostStart) -
+                         static_cast<int64_t>(record.event.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>());
+
+        auto [it, inserted] = offsets.emplace(record.queue, offset);
+
+        if (!inserted)
+            it->second = std::max(it->second, offset);
+    }
+
+    auto micros = [origin](int64_t ns) { return (ns - static_cast<int64_t>(origin)) / 1e3; };
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    out << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"biton\"}}";
+
+    for (const auto& [thread, track] : threads)
+        out << ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << track
+            << ", \"args\": {\"name\": \"host thread " << track << "\"}}";
+
+    for (const auto& [queue, track] : queues)
+        out << ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << track
+            << ", \"args\": {\"name\": \"queue " << track - 1000 << "\"}}";
+
+    for (const auto& record : records_)
+    {
+        int64_t start = static_cast<int64_t>(record.hostStart);
+        int64_t end = static_cast<int64_t>(record.hostEnd);
+        size_t track = 0;
+
+        if (record.onHost)
+        {
+            track = threads.at(record.thread);
+        }
+        else
+        {
+            int64_t offset = offsets.at(record.queue);
+
+            start = static_cast<int64_t>(record.event.getProfilingInfo<CL_PROFILING_COMMAND_START>()) + offset;
+            end = static_cast<int64_t>(record.event.getProfilingInfo<CL_PROFILING_COMMAND_END>()) + offset;
+            track = queues.at(record.queue);
+        }
+
+        out << ",\n  {\"name\": " << jsonString(record.name) << ", \"cat\": " << jsonString(profileKindName(record.kind))
+            << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << track << ", \"ts\": " << micros(start)
+            << ", \"dur\": " << (end - start) / 1e3;
+
+        if (record.stage || record.bytes)
+            out << ", \"args\": {\"stage\": " << record.stage << ", \"subStage\": " << record.subStage
+                << ", \"bytes\": " << record.bytes << "}";
+
+        out << "}";
+    }
+
+    out << "\n]}\n" << std::defaultfloat;
+}
+
+void Profile::roofline(std::ostream& out, double peak) const
+{
+    std::lock_guard lock(mutex);
+
+    struct Row
+    {
+        std::string label;
+        size_t      count = 0;
+        size_t      bytes = 0;
+        double      seconds = 0;
+    };
+
+    std::vector<Row> rows;
+
+    for (const auto& record : records_)
+    {
+        // Transfers cross the host link, not device memory
+        bool onDevice = record.kind == ProfileKind::LocalStage || record.kind == ProfileKind::GlobalStage ||
+                        record.kind == ProfileKind::Kernel || record.kind == ProfileKind::DeviceCopy;
+
+        if (!onDevice || record.bytes == 0)
+            continue;
+
+        std::string label = record.name;
+
+        if (record.kind == ProfileKind::GlobalStage && record.subStage)
+            label = "global substage 2^" + std::to_string(std::countr_zero(record.subStage));
+        else if (record.kind == ProfileKind::GlobalStage && record.stage)
+            label = "global stage 2^" + std::to_string(std::countr_zero(record.stage));
+        else if (record.kind == ProfileKind::LocalStage && record.stage)
+            label = "local stage 2^" + std::to_string(std::countr_zero(record.stage));
+
+        auto row = std::find_if(rows.begin(), rows.end(), [&](const Row& row) { return row.label == label; });
+
+        if (row == rows.end())
+            row = rows.insert(rows.end(), Row{label});
+
+        row->count += 1;
+        row->bytes += record.bytes;
+        row->seconds += seconds(record);
+    }
+
+    out << std::fixed;
+
+    for (const auto& row : rows)
+    {
+        if (row.seconds <= 0)
+            continue;
+
+        double bandwidth = row.bytes / row.seconds;
+
+        out << row.label << ": " << std::setprecision(0) << 100 * bandwidth / peak << "% of peak ("
+            << std::setprecision(2) << bandwidth / 1e9 << " GB/s, " << row.count
+            << (row.count == 1 ? " launch)\n" : " launches)\n");
+    }
+
+    out << std::defaultfloat;
+}
+
+// Times a host phase into a profile (if any) for as long as it is in scope
+class HostSpan
+{
+    Profile*         profile;
+    std::string_view name;
+    ProfileKind      kind;
+    uint64_t         start;
+
+public:
+    HostSpan(Profile* profile, std::string_view name, ProfileKind kind = ProfileKind::Host)
+        : profile(profile), name(name), kind(kind), start(profile ? hostNow() : 0)
+    {}
+
+    HostSpan(const HostSpan&) = delete;
+    HostSpan& operator=(const HostSpan&) = delete;
+
+    ~HostSpan()
+    {
+        if (profile)
+            profile->host(kind, name, start, hostNow());
+    }
+};
+
+// Counts a command about to be enqueued (see counters.hpp): a launch of its
+// kind, or the bytes of a transfer
+void countCommand(ProfileKind kind, size_t bytes)
+{
+    switch (kind)
+    {
+        case ProfileKind::Upload:      count(Counter::UploadBytes, bytes); break;
+        case ProfileKind::Download:    count(Counter::DownloadBytes, bytes); break;
+        case ProfileKind::DeviceCopy:  count(Counter::DeviceCopyBytes, bytes); break;
+        case ProfileKind::LocalStage:  count(Counter::LocalLaunches); break;
+        case ProfileKind::GlobalStage: count(Counter::GlobalLaunches); break;
+        case ProfileKind::Kernel:      count(Counter::OtherLaunches); break;
+        default:                       break;
+    }
+}
+
+cl::Event* profileEvent(Profile* profile, const cl::CommandQueue& queue, ProfileKind kind, std::string_view name,
+                        size_t stage = 0, size_t bytes = 0, size_t subStage = 0)
+{
+    countCommand(kind, bytes);
+
+    return profile ? profile->command(queue, kind, name, stage, bytes, subStage) : nullptr;
+}
+
+cl_command_queue_properties queueProperties(const Profile* profile)
+{
+    return profile ? CL_QUEUE_PROFILING_ENABLE : 0;
+}
+
+}; // namespace bs
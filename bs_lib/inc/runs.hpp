@@ -0,0 +1,291 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "binary.hpp"
+
+namespace bs {
+
+// Unique scratch directory for spilled runs, removed with everything in it
+class TempDir
+{
+    std::filesystem::path path_;
+
+public:
+    explicit TempDir(const std::filesystem::path& parent)
+    {
+        std::string pattern = (parent / "biton-XXXXXX").string();
+
+        if (!::mkdtemp(pattern.data()))
+            throw std::runtime_error("Failed to create temporary directory in " + parent.string());
+
+        path_ = pattern;
+    }
+
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    ~TempDir()
+    {
+        std::error_code ignored;
+        std::filesystem::remove_all(path_, ignored);
+    }
+
+    const std::filesystem::path& path() const { return path_; }
+};
+
+// Reads the keys of a sorted binary file front to back in blocks of
+// blockKeys. Every block is read with one pread and the kernel is asked to
+// prefetch the following one (POSIX_FADV_WILLNEED), so the disk works ahead
+// of the merge without a thread per run.
+template <typename T>
+class RunReader
+{
+    int            fd;
+    std::vector<T> block;
+    size_t         pos = 0;
+    size_t         size = 0;
+    size_t         remaining;
+    off_t          offset = sizeof(BinaryHeader);
+    std::string    fileName;
+
+    void readFully(char* out, size_t bytes, off_t at)
+    {
+        while (bytes > 0)
+        {
+            ssize_t got = ::pread(fd, out, bytes, at);
+
+            if (got < 0 && errno == EINTR)
+                continue;
+
+            if (got <= 0)
+                throw std::runtime_error("Failed to read run: " + fileName);
+
+            out += got;
+            at += got;
+            bytes -= got;
+        }
+    }
+
+    void refill()
+    {
+        size = std::min(block.size(), remaining);
+        pos = 0;
+
+        readFully(reinterpret_cast<char*>(block.data()), sizeof(T) * size, offset);
+
+        offset += sizeof(T) * size;
+        remaining -= size;
+
+        if (remaining > 0)
+            ::posix_fadvise(fd, offset, sizeof(T) * std::min(block.size(), remaining), POSIX_FADV_WILLNEED);
+    }
+
+public:
+    RunReader(std::string_view fileName, size_t blockKeys)
+        : block(blockKeys), fileName(fileName)
+    {
+        fd = ::open(this->fileName.c_str(), O_RDONLY);
+
+        if (fd < 0)
+            throw std::runtime_error("Failed to open file: " + this->fileName);
+
+        BinaryHeader header;
+
+        try
+        {
+            readFully(reinterpret_cast<char*>(&header), sizeof(header), 0);
+        }
+        catch (...)
+        {
+            ::close(fd);
+            throw;
+        }
+
+        if (std::memcmp(header.magic, binaryMagic, sizeof(binaryMagic)) != 0 ||
+            header.keyType != static_cast<uint8_t>(keyTypeOf<T>()))
+        {
+            ::close(fd);
+            throw std::runtime_error("Not a binary key file: " + this->fileName);
+        }
+
+        if (!(header.flags & binarySortedFlag))
+        {
+            ::close(fd);
+            throw std::runtime_error("Binary file is not flagged as sorted: " + this->fileName);
+        }
+
+        remaining = header.count;
+
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        refill();
+    }
+
+    RunReader(const RunReader&) = delete;
+    RunReader& operator=(const RunReader&) = delete;
+
+    ~RunReader()
+    {
+        ::close(fd);
+    }
+
+    bool empty() const { return pos == size; }
+    T front() const { return block[pos]; }
+
+    void pop()
+    {
+        if (++pos == size && remaining > 0)
+            refill();
+    }
+};
+
+// Tournament tree of losers over k sources. Every inner node keeps the
+// source that lost the match played there and node 0 keeps the overall
+// winner, so replacing the winner's key replays only the matches on its
+// path to the root: log2(k) comparisons against the stored losers, without
+// the sibling lookups of a binary heap. Exhausted sources lose every match,
+// equal keys go to the lower source.
+template <typename T>
+class LoserTree
+{
+    std::vector<size_t> losers;
+    std::vector<T>      keys;
+    std::vector<bool>   exhausted;
+
+    bool beats(size_t a, size_t b) const
+    {
+        if (exhausted[a] || exhausted[b])
+            return !exhausted[a];
+
+        return keys[a] < keys[b] || (keys[a] == keys[b] && a < b);
+    }
+
+    void replay()
+    {
+        size_t k = keys.size();
+        size_t winner = losers[0];
+
+        for (size_t node = (winner + k) / 2; node > 0; node /= 2)
+        {
+            if (beats(losers[node], winner))
+                std::swap(losers[node], winner);
+        }
+
+        losers[0] = winner;
+    }
+
+public:
+    // Sources without a key are exhausted from the start
+    explicit LoserTree(const std::vector<std::optional<T>>& first)
+        : losers(first.size()), keys(first.size()), exhausted(first.size())
+    {
+        size_t k = first.size();
+
+        for (size_t i = 0; i < k; ++i)
+        {
+            exhausted[i] = !first[i];
+            keys[i] = first[i].value_or(T{});
+        }
+
+        // Leaves are the implicit nodes k..2k-1, winners are played bottom up
+        std::vector<size_t> winners(2 * k);
+
+        for (size_t i = 0; i < k; ++i)
+            winners[k + i] = i;
+
+        for (size_t node = k - 1; node > 0; --node)
+        {
+            size_t a = winners[2 * node];
+            size_t b = winners[2 * node + 1];
+
+            winners[node] = beats(a, b) ? a : b;
+            losers[node] = beats(a, b) ? b : a;
+        }
+
+        if (k > 0)
+            losers[0] = (k > 1) ? winners[1] : 0;
+    }
+
+    bool empty() const { return keys.empty() || exhausted[losers[0]]; }
+    size_t winner() const { return losers[0]; }
+    T top() const { return keys[losers[0]]; }
+
+    void replace(T key)
+    {
+        keys[losers[0]] = key;
+        replay();
+    }
+
+    void exhaust()
+    {
+        exhausted[losers[0]] = true;
+        replay();
+    }
+};
+
+// k-way merge of sorted binary files through a loser tree. The merged keys
+// are handed to sink(const T*, size_t) in blocks of blockKeys.
+template <typename T, typename Sink>
+void mergeRuns(const std::vector<std::string>& runs, size_t blockKeys, Sink&& sink)
+{
+    std::vector<std::unique_ptr<RunReader<T>>> readers;
+    readers.reserve(runs.size());
+
+    std::vector<std::optional<T>> first;
+    first.reserve(runs.size());
+
+    for (const auto& run : runs)
+    {
+        readers.push_back(std::make_unique<RunReader<T>>(run, blockKeys));
+
+        if (readers.back()->empty())
+            first.push_back(std::nullopt);
+        else
+            first.push_back(readers.back()->front());
+    }
+
+    LoserTree<T> tree(first);
+
+    std::vector<T> out(blockKeys);
+    size_t filled = 0;
+
+    while (!tree.empty())
+    {
+        size_t run = tree.winner();
+
+        out[filled++] = tree.top();
+
+        if (filled == out.size())
+        {
+            sink(out.data(), filled);
+            filled = 0;
+        }
+
+        readers[run]->pop();
+
+        if (readers[run]->empty())
+            tree.exhaust();
+        else
+            tree.replace(readers[run]->front());
+    }
+
+    if (filled > 0)
+        sink(out.data(), filled);
+}
+
+}; // namespace bs
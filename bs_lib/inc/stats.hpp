@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace bs {
+
+// Percentile of sorted samples with linear interpolation between the two
+// closest ranks (numpy's default), p in [0, 100]
+double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty())
+        throw std::invalid_argument("Percentile of no samples");
+
+    double rank = p / 100.0 * (sorted.size() - 1);
+    size_t lower = static_cast<size_t>(rank);
+    size_t upper = std::min(lower + 1, sorted.size() - 1);
+
+    return sorted[lower] + (rank - lower) * (sorted[upper] - sorted[lower]);
+}
+
+// Summary of repeated timings of one measurement, in seconds
+struct Timings
+{
+    std::vector<double> samples;
+    double median = 0;
+    double p10    = 0;
+    double p90    = 0;
+    double mean   = 0;
+    double stddev = 0;
+};
+
+Timings summarize(std::vector<double> samples)
+{
+    Timings timings;
+
+    if (samples.empty())
+        return timings;
+
+    timings.samples = samples;
+
+    std::sort(samples.begin(), samples.end());
+
+    timings.median = percentile(samples, 50);
+    timings.p10 = percentile(samples, 10);
+    timings.p90 = percentile(samples, 90);
+    timings.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+
+    if (samples.size() > 1)
+    {
+        double squares = 0;
+
+        for (double sample : samples)
+            squares += (sample - timings.mean) * (sample - timings.mean);
+
+        timings.stddev = std::sqrt(squares / (samples.size() - 1));
+    }
+
+    return timings;
+}
+
+// One-sided Mann-Whitney U test: the probability of a U statistic at least
+// as large as the observed one if a and b were drawn from one distribution,
+// small when a tends to be larger than b. Makes no assumption about the
+// shape of the timing distributions. Exact for small samples (ties count
+// one half), normal approximation with continuity correction otherwise.
+double mannWhitneyGreater(const std::vector<double>& a, const std::vector<double>& b)
+{
+    if (a.empty() || b.empty())
+        throw std::invalid_argument("Mann-Whitney test of no samples");
+
+    size_t m = a.size();
+    size_t n = b.size();
+    double u = 0;
+
+    for (double x : a)
+    {
+        for (double y : b)
+            u += x > y ? 1 : x == y ? 0.5 : 0;
+    }
+
+    if (m * n > 400)
+    {
+        double mean = m * n / 2.0;
+        double sigma = std::sqrt(m * n * (m + n + 1) / 12.0);
+
+        return 0.5 * std::erfc((u - 0.5 - mean) / sigma / std::sqrt(2.0));
+    }
+
+    // counts[i][j][k]: orderings of i values of a and j of b with U == k. The
+    // largest value is either from a (larger than all j values of b) or from b
+    std::vector<std::vector<std::vector<double>>> counts(m + 1, std::vector<std::vector<double>>(n + 1));
+
+    for (size_t i = 0; i <= m; ++i)
+    {
+        for (size_t j = 0; j <= n; ++j)
+        {
+            counts[i][j].assign(i * j + 1, 0);
+
+            if (i == 0 || j == 0)
+            {
+                counts[i][j][0] = 1;
+                continue;
+            }
+
+            for (size_t k = 0; k <= i * j; ++k)
+            {
+                if (k >= j)
+                    counts[i][j][k] += counts[i - 1][j][k - j];
+
+                if (k <= i * (j - 1))
+                    counts[i][j][k] += counts[i][j - 1][k];
+            }
+        }
+    }
+
+    const std::vector<double>& distribution = counts[m][n];
+    double total = std::accumulate(distribution.begin(), distribution.end(), 0.0);
+    double tail = 0;
+
+    for (size_t k = static_cast<size_t>(std::ceil(u)); k < distribution.size(); ++k)
+        tail += distribution[k];
+
+    return tail / total;
+}
+
+}; // namespace bs
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <algorithm>
+#include <execution>
+#include <vector>
+
+namespace bs {
+
+// Host baselines of --compare, generate uses the parallel one for answers
+void stdSort(std::vector<int>& sequence)
+{
+    std::sort(sequence.begin(), sequence.end());
+}
+
+// libstdc++ runs parallel algorithms on TBB when it is installed, serially
+// otherwise
+void stdSortParallel(std::vector<int>& sequence)
+{
+    std::sort(std::execution::par, sequence.begin(), sequence.end());
+}
+
+}; // namespace bs
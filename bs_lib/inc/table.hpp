@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include "parser.hpp"
+#include "writer.hpp"
+
+namespace bs {
+
+// Integer key column of a delimited text file (CSV, TSV). Rows end with
+// '\n' and fields are split at every delimiter, quoting is not recognized.
+// Every row keeps its bytes in the source text including the newline, so
+// rows can be written out in any order without copying. Empty rows are
+// dropped.
+struct KeyColumn
+{
+    std::vector<std::string_view> rows;
+    std::vector<int32_t>          keys;
+};
+
+// Parses field `column` (0-based) of row into key like a number token of
+// the text formats
+bool parseKeyField(std::string_view row, size_t column, char delimiter, int32_t& key)
+{
+    for (size_t i = 0; i < column; ++i)
+    {
+        size_t pos = row.find(delimiter);
+
+        if (pos == std::string_view::npos)
+            return false;
+
+        row.remove_prefix(pos + 1);
+    }
+
+    std::string_view field = row.substr(0, row.find(delimiter));
+
+    return parseToken(field, key);
+}
+
+// Rows are split at newlines into one chunk per hardware thread and every
+// chunk is parsed concurrently, the chunks are then joined in order.
+KeyColumn parseKeyColumn(std::string_view text, size_t column, char delimiter)
+{
+    constexpr size_t parallelThreshold = 1 << 20;
+
+    size_t threadsCount = std::max(1u, std::thread::hardware_concurrency());
+
+    if (text.size() < parallelThreshold)
+        threadsCount = 1;
+
+    std::vector<std::string_view> chunks;
+    chunks.reserve(threadsCount);
+
+    size_t begin = 0;
+
+    for (size_t i = 1; i <= threadsCount; ++i)
+    {
+        size_t end = (i == threadsCount) ? text.size() : std::max(begin, text.size() / threadsCount * i);
+
+        end = std::min(text.find('\n', end), text.size());
+        end = std::min(end + 1, text.size());
+
+        chunks.push_back(text.substr(begin, end - begin));
+        begin = end;
+    }
+
+    std::vector<KeyColumn> parsed(chunks.size());
+    std::vector<std::optional<size_t>> failedRow(chunks.size());
+
+    auto work = [&](size_t i)
+    {
+        std::string_view chunk = chunks[i];
+
+        while (!chunk.empty())
+        {
+            size_t length = std::min(chunk.find('\n'), chunk.size() - 1) + 1;
+            std::string_view row = chunk.substr(0, length);
+
+            chunk.remove_prefix(length);
+
+            if (row.find_first_not_of("\r\n") == std::string_view::npos)
+                continue;
+
+            int32_t key;
+
+            if (!parseKeyField(row, column, delimiter, key))
+            {
+                failedRow[i] = parsed[i].rows.size();
+                return;
+            }
+
+            parsed[i].rows.push_back(row);
+            parsed[i].keys.push_back(key);
+        }
+    };
+
+    if (chunks.size() == 1)
+    {
+        work(0);
+    }
+    else
+    {
+        std::vector<std::thread> threads;
+        threads.reserve(chunks.size());
+
+        for (size_t i = 0; i < chunks.size(); ++i)
+            threads.emplace_back(work, i);
+
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    KeyColumn result;
+    size_t total = 0;
+
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        if (failedRow[i])
+            throw std::runtime_error("Invalid input. Expected an integer in column " + std::to_string(column + 1) +
+                                     " of row " + std::to_string(total + *failedRow[i] + 1));
+
+        total += parsed[i].rows.size();
+    }
+
+    result.rows.reserve(total);
+    result.keys.reserve(total);
+
+    for (auto& chunk : parsed)
+    {
+        result.rows.insert(result.rows.end(), chunk.rows.begin(), chunk.rows.end());
+        result.keys.insert(result.keys.end(), chunk.keys.begin(), chunk.keys.end());
+    }
+
+    return result;
+}
+
+// Writes the rows in the given order straight from the source text, one
+// iovec per row and one writev per round of rows. A last row without a
+// newline gets one.
+void writeRows(int fd, const KeyColumn& column, const uint32_t* order, size_t n)
+{
+    constexpr size_t rowsPerRound = 1 << 16;
+
+    static const char newline = '\n';
+
+    std::vector<iovec> parts;
+    parts.reserve(std::min(n, rowsPerRound) + 1);
+
+    for (size_t round = 0; round < n; round += rowsPerRound)
+    {
+        parts.clear();
+
+        for (size_t i = round; i < std::min(n, round + rowsPerRound); ++i)
+        {
+            std::string_view row = column.rows[order[i]];
+
+            parts.push_back({const_cast<char*>(row.data()), row.size()});
+
+            if (row.back() != '\n')
+                parts.push_back({const_cast<char*>(&newline), 1});
+        }
+
+        writeAll(fd, parts);
+    }
+}
+
+}; // namespace bs
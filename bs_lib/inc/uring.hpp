@@ -0,0 +1,488 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define BS_HAS_IO_URING 1
+#endif
+
+namespace bs {
+
+#ifdef BS_HAS_IO_URING
+
+// Minimal io_uring on the raw syscalls, no liburing: the submission and
+// completion rings are mapped from the kernel and driven by one thread.
+// Throws std::system_error when the kernel (or a seccomp filter) refuses
+// the ring, callers fall back to plain reads.
+class IoUring
+{
+    int            fd = -1;
+    io_uring_params params{};
+
+    void*  sqRing = MAP_FAILED;
+    void*  cqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    io_uring_cqe* cqes = nullptr;
+
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+
+    bool fixedBuffers = false;
+
+    template <typename T>
+    T* at(void* ring, uint32_t offset)
+    {
+        return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+    }
+
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags)
+    {
+        int ret;
+
+        do
+        {
+            ret = static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+        }
+        while (ret < 0 && errno == EINTR);
+
+        if (ret < 0)
+            throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+
+        return ret;
+    }
+
+    void release()
+    {
+        if (sqes != MAP_FAILED)
+            ::munmap(sqes, params.sq_entries * sizeof(io_uring_sqe));
+
+        if (cqRing != MAP_FAILED && cqRing != sqRing)
+            ::munmap(cqRing, cqRingSize);
+
+        if (sqRing != MAP_FAILED)
+            ::munmap(sqRing, sqRingSize);
+
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+public:
+    explicit IoUring(unsigned entries)
+    {
+        fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+        bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+
+        if (singleMmap)
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+        sqRing = ::mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        cqRing = singleMmap ? sqRing
+                            : ::mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                                                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+
+        if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED)
+        {
+            int error = errno;
+            release();
+            throw std::system_error(error, std::generic_category(), "io_uring mmap");
+        }
+
+        sqHead  = at<unsigned>(sqRing, params.sq_off.head);
+        sqTail  = at<unsigned>(sqRing, params.sq_off.tail);
+        sqMask  = at<unsigned>(sqRing, params.sq_off.ring_mask);
+        sqArray = at<unsigned>(sqRing, params.sq_off.array);
+        cqHead  = at<unsigned>(cqRing, params.cq_off.head);
+        cqTail  = at<unsigned>(cqRing, params.cq_off.tail);
+        cqMask  = at<unsigned>(cqRing, params.cq_off.ring_mask);
+        cqes    = at<io_uring_cqe>(cqRing, params.cq_off.cqes);
+    }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    ~IoUring()
+    {
+        release();
+    }
+
+    // Pins the buffers once, reads into them then skip the per-read page
+    // mapping. Without it (RLIMIT_MEMLOCK) plain reads are submitted.
+    void registerBuffers(const std::vector<iovec>& buffers)
+    {
+        fixedBuffers = ::syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS,
+                                 buffers.data(), static_cast<unsigned>(buffers.size())) == 0;
+    }
+
+    // Queues a read of size bytes at offset into buffer, which lies in the
+    // registered buffer bufferIndex. The completion carries userData.
+    void submitRead(int fileFd, unsigned bufferIndex, char* buffer, size_t size, uint64_t offset, uint64_t userData)
+    {
+        unsigned tail = *sqTail;
+        unsigned index = tail & *sqMask;
+
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+
+        sqe.opcode    = fixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe.fd        = fileFd;
+        sqe.addr      = reinterpret_cast<uint64_t>(buffer);
+        sqe.len       = static_cast<uint32_t>(size);
+        sqe.off       = offset;
+        sqe.buf_index = static_cast<uint16_t>(bufferIndex);
+        sqe.user_data = userData;
+
+        sqArray[index] = index;
+
+        std::atomic_ref<unsigned>(*sqTail).store(tail + 1, std::memory_order_release);
+
+        enter(1, 0, 0);
+    }
+
+    // Waits for the next completion and takes it off the ring
+    io_uring_cqe waitCompletion()
+    {
+        while (true)
+        {
+            unsigned head = *cqHead;
+
+            if (head != std::atomic_ref<unsigned>(*cqTail).load(std::memory_order_acquire))
+            {
+                io_uring_cqe cqe = cqes[head & *cqMask];
+
+                std::atomic_ref<unsigned>(*cqHead).store(head + 1, std::memory_order_release);
+
+                return cqe;
+            }
+
+            enter(0, 1, IORING_ENTER_GETEVENTS);
+        }
+    }
+};
+
+#endif
+
+// Reads a file front to back in blocks of blockSize. With io_uring up to
+// depth reads are in flight at once, each into its own registered buffer,
+// so the disk keeps reading ahead while the caller parses or uploads the
+// block it was handed. Without io_uring (old kernel, seccomp, a pipe) every
+// block is read with pread, or read for streams that can not seek.
+class AsyncFileReader
+{
+    struct Slot
+    {
+        uint64_t offset = 0;
+        size_t   wanted = 0;
+        size_t   filled = 0;
+        bool     pending = false;
+    };
+
+    int    fd = -1;
+    bool   ownsFd = false;
+    bool   seekable = false;
+    size_t blockSize;
+    size_t depth;
+    uint64_t dataStart = 0;     // position of fd when the reader took it
+    uint64_t fileSize = 0;
+
+    std::vector<char> buffers;
+    std::vector<Slot> slots;
+
+    size_t nextBlock = 0;       // next block handed out
+    size_t submittedBlocks = 0;
+    size_t inFlight = 0;
+    std::optional<size_t> handedOut;
+    uint64_t readOffset = 0;    // pread fallback
+    bool     eof = false;
+
+#ifdef BS_HAS_IO_URING
+    std::optional<IoUring> ring;
+
+    void submitRest(size_t slot)
+    {
+        Slot& s = slots[slot];
+
+        ring->submitRead(fd, static_cast<unsigned>(slot), buffers.data() + slot * blockSize + s.filled,
+                         s.wanted - s.filled, s.offset + s.filled, slot);
+        ++inFlight;
+    }
+
+    void submitBlock(size_t slot)
+    {
+        uint64_t offset = dataStart + static_cast<uint64_t>(submittedBlocks) * blockSize;
+
+        if (offset >= fileSize)
+            return;
+
+        slots[slot] = Slot{offset, static_cast<size_t>(std::min<uint64_t>(blockSize, fileSize - offset)), 0, true};
+        ++submittedBlocks;
+
+        submitRest(slot);
+    }
+
+    void complete()
+    {
+        io_uring_cqe cqe = ring->waitCompletion();
+        --inFlight;
+
+        Slot& s = slots[cqe.user_data];
+
+        if (cqe.res == -EAGAIN || cqe.res == -EINTR)
+        {
+            submitRest(cqe.user_data);
+            return;
+        }
+
+        if (cqe.res < 0)
+            throw std::system_error(-cqe.res, std::generic_category(), "Failed to read input");
+
+        s.filled += cqe.res;
+
+        // A short read is resumed, a read at the end of a file that shrank
+        // meanwhile ends the block where it is
+        if (cqe.res > 0 && s.filled < s.wanted)
+            submitRest(cqe.user_data);
+        else
+            s.pending = false;
+    }
+#endif
+
+    std::string_view readBlock()
+    {
+        char* out = buffers.data();
+        size_t filled = 0;
+
+        while (filled < blockSize && !eof)
+        {
+            ssize_t got = seekable ? ::pread(fd, out + filled, blockSize - filled, readOffset)
+                                   : ::read(fd, out + filled, blockSize - filled);
+
+            if (got < 0 && errno == EINTR)
+                continue;
+
+            if (got < 0)
+                throw std::system_error(errno, std::generic_category(), "Failed to read input");
+
+            eof = (got == 0);
+            filled += got;
+            readOffset += got;
+        }
+
+        return {out, filled};
+    }
+
+    void open(bool tryIoUring)
+    {
+        struct stat st;
+
+        if (::fstat(fd, &st) != 0)
+            throw std::system_error(errno, std::generic_category(), "Failed to stat input");
+
+        seekable = S_ISREG(st.st_mode);
+
+        if (seekable)
+        {
+            off_t position = ::lseek(fd, 0, SEEK_CUR);
+
+            dataStart = readOffset = (position > 0) ? position : 0;
+            fileSize = static_cast<uint64_t>(st.st_size);
+
+            ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        }
+
+#ifdef BS_HAS_IO_URING
+        // Reads of a pipe complete in no particular order, only files get a ring
+        if (tryIoUring && seekable && fileSize > dataStart)
+        {
+            try
+            {
+                ring.emplace(static_cast<unsigned>(std::bit_ceil(depth)));
+            }
+            catch (const std::system_error&)
+            {
+                ring.reset();
+            }
+        }
+
+        if (ring)
+        {
+            buffers.resize(depth * blockSize);
+            slots.resize(depth);
+
+            std::vector<iovec> registered;
+
+            for (size_t slot = 0; slot < depth; ++slot)
+                registered.push_back({buffers.data() + slot * blockSize, blockSize});
+
+            ring->registerBuffers(registered);
+
+            for (size_t slot = 0; slot < depth; ++slot)
+                submitBlock(slot);
+
+            return;
+        }
+#endif
+
+        buffers.resize(blockSize);
+    }
+
+public:
+    AsyncFileReader(int fd, size_t blockSize = 1 << 20, size_t depth = 4, bool tryIoUring = true)
+        : fd(fd), blockSize(blockSize), depth(std::max<size_t>(depth, 1))
+    {
+        open(tryIoUring);
+    }
+
+    AsyncFileReader(std::string_view fileName, size_t blockSize = 1 << 20, size_t depth = 4, bool tryIoUring = true)
+        : ownsFd(true), blockSize(blockSize), depth(std::max<size_t>(depth, 1))
+    {
+        fd = ::open(std::string(fileName).c_str(), O_RDONLY);
+
+        if (fd < 0)
+            throw std::runtime_error("Failed to open file: " + std::string(fileName));
+
+        try
+        {
+            open(tryIoUring);
+        }
+        catch (...)
+        {
+            ::close(fd);
+            throw;
+        }
+    }
+
+    AsyncFileReader(const AsyncFileReader&) = delete;
+    AsyncFileReader& operator=(const AsyncFileReader&) = delete;
+
+    ~AsyncFileReader()
+    {
+#ifdef BS_HAS_IO_URING
+        // The kernel may still write into the buffers until every read completes
+        while (ring && inFlight > 0)
+        {
+            try
+            {
+                ring->waitCompletion();
+                --inFlight;
+            }
+            catch (...)
+            {
+                break;
+            }
+        }
+#endif
+
+        if (ownsFd)
+            ::close(fd);
+    }
+
+    bool usesIoUring() const
+    {
+#ifdef BS_HAS_IO_URING
+        return ring.has_value();
+#else
+        return false;
+#endif
+    }
+
+    // Next block of the file, valid until the following call. Empty at the
+    // end of the file.
+    std::string_view next()
+    {
+#ifdef BS_HAS_IO_URING
+        if (ring)
+        {
+            // The buffer of the block handed out last is free to read ahead again
+            if (handedOut)
+                submitBlock(*handedOut);
+
+            handedOut.reset();
+
+            if (nextBlock >= submittedBlocks)
+                return {};
+
+            size_t slot = nextBlock % depth;
+
+            while (slots[slot].pending)
+                complete();
+
+            ++nextBlock;
+            handedOut = slot;
+
+            return {buffers.data() + slot * blockSize, slots[slot].filled};
+        }
+#endif
+
+        return readBlock();
+    }
+};
+
+// std::streambuf over an AsyncFileReader, so the stream parsers consume
+// completed blocks while the following ones are still being read
+class AsyncReadBuf : public std::streambuf
+{
+    AsyncFileReader reader;
+
+protected:
+    int_type underflow() override
+    {
+        std::string_view block = reader.next();
+
+        if (block.empty())
+            return traits_type::eof();
+
+        char* data = const_cast<char*>(block.data());
+        setg(data, data, data + block.size());
+
+        return traits_type::to_int_type(*gptr());
+    }
+
+public:
+    explicit AsyncReadBuf(int fd)
+        : reader(fd)
+    {}
+
+    explicit AsyncReadBuf(std::string_view fileName)
+        : reader(fileName)
+    {}
+
+    bool usesIoUring() const { return reader.usesIoUring(); }
+};
+
+}; // namespace bs
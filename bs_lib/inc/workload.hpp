@@ -0,0 +1,325 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace bs {
+
+// Input distributions of the benchmarks and e2e tests. Bitonic and odd-even
+// networks do the same work for any input, the radix engine and std::sort
+// do not.
+enum class Distribution
+{
+    Uniform,
+    Sorted,
+    Reverse,
+    NearlySorted,
+    FewUnique,
+    Zipf,
+    AllEqual,
+    OrganPipe,
+    Staggered
+};
+
+Distribution parseDistribution(std::string_view name)
+{
+    if (name == "uniform")
+        return Distribution::Uniform;
+
+    if (name == "sorted")
+        return Distribution::Sorted;
+
+    if (name == "reverse")
+        return Distribution::Reverse;
+
+    if (name == "nearly-sorted")
+        return Distribution::NearlySorted;
+
+    if (name == "few-unique")
+        return Distribution::FewUnique;
+
+    if (name == "zipf")
+        return Distribution::Zipf;
+
+    if (name == "all-equal")
+        return Distribution::AllEqual;
+
+    if (name == "organ-pipe")
+        return Distribution::OrganPipe;
+
+    if (name == "staggered")
+        return Distribution::Staggered;
+
+    throw std::invalid_argument("Unknown distribution: " + std::string(name) +
+                                ". Expected uniform, sorted, reverse, nearly-sorted, few-unique, zipf, all-equal, "
+                                "organ-pipe or staggered");
+}
+
+std::string_view distributionName(Distribution distribution)
+{
+    switch (distribution)
+    {
+        case Distribution::Uniform:      return "uniform";
+        case Distribution::Sorted:       return "sorted";
+        case Distribution::Reverse:      return "reverse";
+        case Distribution::NearlySorted: return "nearly-sorted";
+        case Distribution::FewUnique:    return "few-unique";
+        case Distribution::Zipf:         return "zipf";
+        case Distribution::AllEqual:     return "all-equal";
+        case Distribution::OrganPipe:    return "organ-pipe";
+        case Distribution::Staggered:    return "staggered";
+    }
+
+    throw std::invalid_argument("Unknown distribution");
+}
+
+// SplitMix64: the i-th random number of a seed is a function of seed + i,
+// so any range of the sequence can be generated on its own
+constexpr uint64_t splitMix64(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+
+    return x ^ (x >> 31);
+}
+
+// n keys of a distribution spread over the whole int range. Any range of
+// the sequence is generated on its own, so threads can fill (or format)
+// blocks of a sequence that does not fit in memory independently.
+//   nearly-sorted: sorted, every window of 1024 keys has 1% of its keys
+//                  swapped with a random partner in the window
+//   few-unique:    16 distinct keys
+//   zipf:          65536 distinct keys, the k-th most frequent drawn with
+//                  probability proportional to 1 / k
+//   all-equal:     one key
+//   organ-pipe:    ascending first half, descending second half
+//   staggered:     64 blocks, each drawn from its own 1/64 of the range, the
+//                  ranges of the first half of the blocks interleave with
+//                  those of the second half (Helman, Bader, JaJa)
+class KeyGenerator
+{
+public:
+    static constexpr size_t nearlySortedWindow = 1024;
+    static constexpr size_t fewUniqueKeys = 16;
+    static constexpr size_t zipfKeys = 1 << 16;
+    static constexpr size_t staggeredBlocks = 64;
+
+private:
+    Distribution distribution;
+    size_t       n;
+    uint64_t     seed;
+
+    // Alias table of the Zipf ranks (Vose): a rank is drawn uniformly and
+    // kept if a second uniform draw is below its threshold, else replaced
+    // by its alias
+    std::vector<uint32_t> zipfThreshold;
+    std::vector<uint32_t> zipfAlias;
+
+    uint64_t random(size_t i) const { return splitMix64(seed + i); }
+
+    static int toKey(uint64_t bits) { return static_cast<int>(static_cast<uint32_t>(bits)); }
+
+    // i-th of m keys evenly spread from INT_MIN to INT_MAX
+    static int spread(size_t i, size_t m)
+    {
+        double step = (static_cast<double>(std::numeric_limits<int>::max()) - std::numeric_limits<int>::min()) /
+                      std::max<size_t>(m, 1);
+
+        return static_cast<int>(std::numeric_limits<int>::min() + step * i);
+    }
+
+    int rankKey(uint64_t rank) const { return toKey(splitMix64(~seed + rank)); }
+
+    void nearlySorted(size_t first, int* keys, size_t count) const
+    {
+        int window[nearlySortedWindow];
+
+        for (size_t start = first / nearlySortedWindow * nearlySortedWindow; start < first + count;
+             start += nearlySortedWindow)
+        {
+            size_t size = std::min(nearlySortedWindow, n - start);
+
+            for (size_t k = 0; k < size; ++k)
+                window[k] = spread(start + k, n);
+
+            for (size_t k = 0; k < size / 100; ++k)
+                std::swap(window[random(2 * (start + k)) % size], window[random(2 * (start + k) + 1) % size]);
+
+            size_t from = std::max(first, start);
+            size_t to = std::min(first + count, start + size);
+
+            std::copy(window + (from - start), window + (to - start), keys + (from - first));
+        }
+    }
+
+public:
+    KeyGenerator(Distribution distribution, size_t n, uint64_t seed)
+        : distribution(distribution), n(n), seed(seed)
+    {
+        if (distribution != Distribution::Zipf)
+            return;
+
+        double norm = 0;
+
+        for (size_t rank = 1; rank <= zipfKeys; ++rank)
+            norm += 1.0 / rank;
+
+        std::vector<double> scaled(zipfKeys);
+        std::vector<uint32_t> small, large;
+
+        for (size_t rank = 0; rank < zipfKeys; ++rank)
+        {
+            scaled[rank] = static_cast<double>(zipfKeys) / (rank + 1) / norm;
+            (scaled[rank] < 1 ? small : large).push_back(static_cast<uint32_t>(rank));
+        }
+
+        zipfThreshold.assign(zipfKeys, std::numeric_limits<uint32_t>::max());
+        zipfAlias.resize(zipfKeys);
+
+        for (size_t rank = 0; rank < zipfKeys; ++rank)
+            zipfAlias[rank] = static_cast<uint32_t>(rank);
+
+        while (!small.empty() && !large.empty())
+        {
+            uint32_t less = small.back();
+            uint32_t more = large.back();
+            small.pop_back();
+
+            zipfThreshold[less] = static_cast<uint32_t>(scaled[less] * 4294967295.0);
+            zipfAlias[less] = more;
+
+            scaled[more] -= 1 - scaled[less];
+
+            if (scaled[more] < 1)
+            {
+                large.pop_back();
+                small.push_back(more);
+            }
+        }
+    }
+
+    size_t size() const { return n; }
+
+    // Keys first, ..., first + count - 1 of the sequence into keys
+    void operator()(size_t first, int* keys, size_t count) const
+    {
+        switch (distribution)
+        {
+            case Distribution::Uniform:
+                for (size_t k = 0; k < count; ++k)
+                    keys[k] = toKey(random(first + k));
+                break;
+
+            case Distribution::Sorted:
+                for (size_t k = 0; k < count; ++k)
+                    keys[k] = spread(first + k, n);
+                break;
+
+            case Distribution::Reverse:
+                for (size_t k = 0; k < count; ++k)
+                    keys[k] = spread(n - 1 - (first + k), n);
+                break;
+
+            case Distribution::NearlySorted:
+                nearlySorted(first, keys, count);
+                break;
+
+            case Distribution::FewUnique:
+                for (size_t k = 0; k < count; ++k)
+                    keys[k] = toKey(splitMix64(seed + random(first + k) % fewUniqueKeys));
+                break;
+
+            case Distribution::Zipf:
+                for (size_t k = 0; k < count; ++k)
+                {
+                    uint64_t bits = random(first + k);
+                    uint32_t rank = static_cast<uint32_t>(bits >> 48);
+
+                    if (static_cast<uint32_t>(bits) > zipfThreshold[rank])
+                        rank = zipfAlias[rank];
+
+                    keys[k] = rankKey(rank);
+                }
+                break;
+
+            case Distribution::AllEqual:
+                std::fill_n(keys, count, toKey(splitMix64(seed)));
+                break;
+
+            case Distribution::OrganPipe:
+            {
+                size_t half = (n + 1) / 2;
+
+                for (size_t k = 0; k < count; ++k)
+                {
+                    size_t i = first + k;
+                    keys[k] = spread(i < half ? i : n - 1 - i, half);
+                }
+                break;
+            }
+
+            case Distribution::Staggered:
+            {
+                constexpr uint64_t width = (uint64_t(1) << 32) / staggeredBlocks;
+
+                for (size_t k = 0; k < count; ++k)
+                {
+                    size_t i = first + k;
+                    uint64_t block = static_cast<uint64_t>(i) * staggeredBlocks / std::max<size_t>(n, 1);
+                    uint64_t low = block < staggeredBlocks / 2 ? (2 * block + 1) * width
+                                                               : (2 * block - staggeredBlocks) * width;
+
+                    keys[k] = static_cast<int>(static_cast<int64_t>(std::numeric_limits<int>::min()) +
+                                               static_cast<int64_t>(low + random(i) % width));
+                }
+                break;
+            }
+        }
+    }
+};
+
+// count keys of the sequence from first on into keys, split over the
+// hardware threads
+void generateKeys(const KeyGenerator& generator, size_t first, int* keys, size_t count)
+{
+    constexpr size_t minThreadKeys = 1 << 16;
+
+    size_t threadsCount = std::clamp<size_t>(count / minThreadKeys, 1, std::max(1u, std::thread::hardware_concurrency()));
+
+    if (threadsCount == 1)
+    {
+        generator(first, keys, count);
+        return;
+    }
+
+    size_t threadKeys = (count + threadsCount - 1) / threadsCount;
+    std::vector<std::thread> threads;
+    threads.reserve(threadsCount);
+
+    for (size_t begin = 0; begin < count; begin += threadKeys)
+    {
+        size_t size = std::min(threadKeys, count - begin);
+        threads.emplace_back([&generator, first, keys, begin, size] { generator(first + begin, keys + begin, size); });
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+}
+
+std::vector<int> generateKeys(Distribution distribution, size_t n, uint64_t seed)
+{
+    std::vector<int> keys(n);
+
+    generateKeys(KeyGenerator(distribution, n, seed), 0, keys.data(), n);
+
+    return keys;
+}
+
+}; // namespace bs
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <charconv>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace bs {
+
+// Writes every iovec completely, resuming after partial writes and EINTR
+void writeAll(int fd, std::vector<iovec>& parts)
+{
+    size_t first = 0;
+
+    while (first < parts.size())
+    {
+        int count = static_cast<int>(std::min<size_t>(parts.size() - first, IOV_MAX));
+        ssize_t written = ::writev(fd, parts.data() + first, count);
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            throw std::runtime_error("Failed to write output");
+        }
+
+        size_t left = static_cast<size_t>(written);
+
+        while (first < parts.size() && left >= parts[first].iov_len)
+            left -= parts[first++].iov_len;
+
+        if (left > 0)
+        {
+            parts[first].iov_base = static_cast<char*>(parts[first].iov_base) + left;
+            parts[first].iov_len -= left;
+        }
+    }
+}
+
+// Longest to_chars output of one key: sign and digits of an integer, or the
+// shortest round-trip form of a floating point key ("-1.17549435e-38")
+template <typename T>
+constexpr size_t maxKeyChars()
+{
+    if constexpr (std::is_floating_point_v<T>)
+        return std::numeric_limits<T>::max_digits10 + 7;
+    else
+        return std::numeric_limits<T>::digits10 + 2;
+}
+
+// Formats "v " for each key into out, out must hold n * (maxKeyChars + 1)
+// chars. Returns the number of chars written.
+template <typename T>
+size_t formatValues(const T* keys, size_t n, char* out)
+{
+    char* pos = out;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        pos = std::to_chars(pos, pos + maxKeyChars<T>(), keys[i]).ptr;
+        *pos++ = ' ';
+    }
+
+    return pos - out;
+}
+
+// Writes "v " for every key, formatted with to_chars into per-thread buffers
+// and written with one writev per round. A round formats blockSize keys on
+// every hardware thread, so memory stays bounded for any n.
+template <typename T>
+void writeTextBlock(int fd, const T* keys, size_t n)
+{
+    constexpr size_t blockSize = 1 << 18;
+    constexpr size_t maxChars = maxKeyChars<T>() + 1;
+
+    size_t threadsCount = std::max(1u, std::thread::hardware_concurrency());
+    threadsCount = std::min(threadsCount, (n + blockSize - 1) / blockSize);
+    threadsCount = std::max<size_t>(threadsCount, 1);
+
+    std::vector<std::vector<char>> buffers(threadsCount, std::vector<char>(std::min(n, blockSize) * maxChars));
+    std::vector<size_t> lengths(threadsCount);
+
+    for (size_t round = 0; round < n; round += threadsCount * blockSize)
+    {
+        auto format = [&](size_t t)
+        {
+            size_t begin = std::min(n, round + t * blockSize);
+            size_t end = std::min(n, begin + blockSize);
+
+            lengths[t] = formatValues(keys + begin, end - begin, buffers[t].data());
+        };
+
+        if (threadsCount == 1)
+        {
+            format(0);
+        }
+        else
+        {
+            std::vector<std::thread> threads;
+            threads.reserve(threadsCount);
+
+            for (size_t t = 0; t < threadsCount; ++t)
+                threads.emplace_back(format, t);
+
+            for (auto& thread : threads)
+                thread.join();
+        }
+
+        std::vector<iovec> parts;
+        parts.reserve(threadsCount);
+
+        for (size_t t = 0; t < threadsCount; ++t)
+        {
+            if (lengths[t] > 0)
+                parts.push_back({buffers[t].data(), lengths[t]});
+        }
+
+        writeAll(fd, parts);
+    }
+}
+
+// Keys separated by spaces and a final newline. For integer keys these are
+// the same bytes as `for (...) std::cout << keys[i] << " "; std::cout << '\n';`,
+// float and double keys are written in the shortest form that reads back to
+// the same value, which std::cout's default precision does not give.
+template <typename T>
+void writeText(int fd, const T* keys, size_t n)
+{
+    writeTextBlock(fd, keys, n);
+
+    char newline = '\n';
+    std::vector<iovec> parts{{&newline, 1}};
+
+    writeAll(fd, parts);
+}
+
+}; // namespace bs
@@ -0,0 +1,132 @@
+#include "workload.hpp"
+#include "writer.hpp"
+#include "binary.hpp"
+#include "stdsort.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <optional>
+
+#include <cxxopts.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+void writeTextInput(const std::string& fileName, const bs::KeyGenerator& generator);
+void writeBinaryInput(const std::string& fileName, const bs::KeyGenerator& generator, bool sorted);
+void writeAnswer(const std::string& fileName, const bs::KeyGenerator& generator);
+
+int main(int argc, const char* argv[]) try
+{
+    cxxopts::Options options("generate", "Input generator of the benchmarks and e2e tests");
+    options.add_options()
+        ("n,count", "Number of keys", cxxopts::value<size_t>())
+        ("d,dist", "Distribution (uniform, sorted, reverse, nearly-sorted, few-unique, zipf, all-equal, organ-pipe, "
+                   "staggered)", cxxopts::value<std::string>()->default_value("uniform"))
+        ("seed", "Seed of the keys", cxxopts::value<uint64_t>()->default_value("1"))
+        ("o,output", "Input file: the count and the keys as text, or a binary key file with --binary",
+            cxxopts::value<std::string>())
+        ("b,binary", "Write a binary key file instead of text")
+        ("a,answer", "Also write the sorted keys to this file, as biton prints them", cxxopts::value<std::string>())
+        ("h,help", "Print usage");
+
+    auto result = options.parse(argc, argv);
+    if (result.count("help"))
+    {
+        std::cout << options.help() << std::endl;
+        exit(0);
+    }
+
+    if (not result.count("count") || not result.count("output"))
+        throw std::invalid_argument("--count and --output are required");
+
+    bs::Distribution distribution = bs::parseDistribution(result["dist"].as<std::string>());
+    bs::KeyGenerator generator(distribution, result["count"].as<size_t>(), result["seed"].as<uint64_t>());
+
+    if (result.count("binary"))
+    {
+        bool sorted = distribution == bs::Distribution::Sorted || distribution == bs::Distribution::AllEqual;
+        writeBinaryInput(result["output"].as<std::string>(), generator, sorted);
+    }
+    else
+    {
+        writeTextInput(result["output"].as<std::string>(), generator);
+    }
+
+    if (result.count("answer"))
+        writeAnswer(result["answer"].as<std::string>(), generator);
+}
+catch (const std::exception& e)
+{
+    std::cout << "Error: " << e.what() << std::endl;
+    return 1;
+}
+
+int createFile(const std::string& fileName)
+{
+    int fd = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0)
+        throw std::runtime_error("Failed to create file: " + fileName);
+
+    return fd;
+}
+
+// The count, then the keys generated and formatted block by block, so the
+// input may be larger than memory
+void writeTextInput(const std::string& fileName, const bs::KeyGenerator& generator)
+{
+    constexpr size_t blockSize = 1 << 24;
+
+    int fd = createFile(fileName);
+    size_t n = generator.size();
+
+    std::string count = std::to_string(n) + "\n";
+    std::vector<iovec> header{{count.data(), count.size()}};
+    bs::writeAll(fd, header);
+
+    std::vector<int> block(std::min(n, blockSize));
+
+    for (size_t first = 0; first < n; first += blockSize)
+    {
+        size_t size = std::min(blockSize, n - first);
+
+        bs::generateKeys(generator, first, block.data(), size);
+        bs::writeTextBlock(fd, block.data(), size);
+    }
+
+    char newline = '\n';
+    std::vector<iovec> end{{&newline, 1}};
+    bs::writeAll(fd, end);
+
+    ::close(fd);
+}
+
+// The keys are generated straight into the mapped file
+void writeBinaryInput(const std::string& fileName, const bs::KeyGenerator& generator, bool sorted)
+{
+    bs::BinaryWriter<int> writer(fileName, generator.size());
+
+    bs::generateKeys(generator, 0, writer.keys(), generator.size());
+
+    writer.finish(sorted);
+}
+
+// The expected output of an e2e test, the whole sequence is sorted in memory
+void writeAnswer(const std::string& fileName, const bs::KeyGenerator& generator)
+{
+    std::vector<int> keys(generator.size());
+
+    bs::generateKeys(generator, 0, keys.data(), keys.size());
+    bs::stdSortParallel(keys);
+
+    int fd = createFile(fileName);
+
+    // biton prints nothing at all for an empty sequence
+    if (!keys.empty())
+        bs::writeText(fd, keys.data(), keys.size());
+
+    ::close(fd);
+}
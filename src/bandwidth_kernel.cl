@@ -0,0 +1,9 @@
+// Streaming copy for the peak bandwidth of device memory: every work item
+// reads one int and writes one int, consecutive items touch consecutive ints
+__kernel void bandwidthCopy_kernel(__global const int* src,
+                             __global int* dst)
+{
+    size_t i = get_global_id(0);
+
+    dst[i] = src[i];
+}
@@ -0,0 +1,82 @@
+// Kernels for CPU devices: one work item owns a contiguous block of
+// elements and walks it with plain loops, no local memory and no barriers.
+// Comparators are enumerated directly (no i ^ subStage filtering) and
+// exchanged with min/max, which keeps the inner loops vectorizable.
+
+#ifndef index_t
+#define index_t int
+#endif
+
+#ifndef key_t
+#define key_t int
+#endif
+
+#ifdef key_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+void compareExchange_cpu(__global key_t* arr, index_t i, index_t j, int ascending) {
+    key_t a = arr[i];
+    key_t b = arr[j];
+    key_t lo = min(a, b);
+    key_t hi = max(a, b);
+    arr[i] = ascending ? lo : hi;
+    arr[j] = ascending ? hi : lo;
+}
+
+// Lower index of comparator c when pairs are subStage apart
+index_t comparatorIndex_cpu(index_t c, index_t subStage) {
+    return ((c & ~(subStage - 1)) << 1) | (c & (subStage - 1));
+}
+
+// All stages up to block inside the work item's block
+__kernel void bitonicBlockSort_ckernel(__global key_t* arr, int block)
+{
+    index_t base = get_global_id(0) * block;
+    
+    for (int stage = 2; stage <= block; stage *= 2)
+    {
+        for (int subStage = stage / 2; subStage > 0; subStage /= 2)
+        {
+            for (int c = 0; c < block / 2; c++)
+            {
+                index_t i = base + comparatorIndex_cpu(c, subStage);
+                
+                compareExchange_cpu(arr, i, i + subStage, (i & stage) == 0);
+            }
+        }
+    }
+}
+
+// One substage with subStage >= block: the work item owns block / 2
+// consecutive comparators
+__kernel void bitonicBlockStep_ckernel(__global key_t* arr, 
+                                 index_t stage, 
+                                 index_t subStage, 
+                                 int block)
+{
+    index_t first = get_global_id(0) * (block / 2);
+    
+    for (index_t c = first; c < first + block / 2; c++)
+    {
+        index_t i = comparatorIndex_cpu(c, subStage);
+        
+        compareExchange_cpu(arr, i, i + subStage, (i & stage) == 0);
+    }
+}
+
+// Remaining substages of a stage (block / 2 down to 1) inside the block
+__kernel void bitonicBlockMerge_ckernel(__global key_t* arr, index_t stage, int block)
+{
+    index_t base = get_global_id(0) * block;
+    
+    for (int subStage = block / 2; subStage > 0; subStage /= 2)
+    {
+        for (int c = 0; c < block / 2; c++)
+        {
+            index_t i = base + comparatorIndex_cpu(c, subStage);
+            
+            compareExchange_cpu(arr, i, i + subStage, (i & stage) == 0);
+        }
+    }
+}
@@ -1,20 +1,34 @@
-void compareAndSwap_global(__global int* arr, int i, int j, int dir) {
+// Index type, the host builds with -D index_t=long for sequences over INT_MAX
+#ifndef index_t
+#define index_t int
+#endif
+
+// Key type, built with -D key_t=long (uint, float, double) for typed keys
+#ifndef key_t
+#define key_t int
+#endif
+
+#ifdef key_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+void compareAndSwap_global(__global key_t* arr, index_t i, index_t j, int dir) {
     if ((arr[i] > arr[j] && dir == 1) || (arr[i] < arr[j] && dir == 0)) {
-        int temp = arr[i];
+        key_t temp = arr[i];
         arr[i] = arr[j];
         arr[j] = temp;
     }
 }
 
-__kernel void bitonicStep_gkernel(__global int* arr, 
-                            int stage,
-                            int subStage,
+__kernel void bitonicStep_gkernel(__global key_t* arr, 
+                            index_t stage,
+                            index_t subStage,
                             int dir)
 {
     
-    int i = get_global_id(0);
+    index_t i = get_global_id(0);
     
-    int l = i ^ subStage;
+    index_t l = i ^ subStage;
     
     if (l > i)
     {
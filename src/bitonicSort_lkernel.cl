@@ -1,19 +1,31 @@
-void compareAndSwap_local(__local int* arr, int i, int j, int dir) {
+#ifndef index_t
+#define index_t int
+#endif
+
+#ifndef key_t
+#define key_t int
+#endif
+
+#ifdef key_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+void compareAndSwap_local(__local key_t* arr, int i, int j, int dir) {
     if ((arr[i] > arr[j] && dir == 1) || (arr[i] < arr[j] && dir == 0)) {
-        int temp = arr[i];
+        key_t temp = arr[i];
         arr[i] = arr[j];
         arr[j] = temp;
     }
 }
 
-__kernel void bitonicStep_lkernel(__global int* arr, 
-                          int stage,
-                          __local int* locarr,
-                          int n)
+__kernel void bitonicStep_lkernel(__global key_t* arr, 
+                          index_t stage,
+                          __local key_t* locarr,
+                          index_t n)
 {
-    int globalId = get_global_id(0);
+    index_t globalId = get_global_id(0);
     int localId = get_local_id(0);
-    int groupId = get_group_id(0);
+    index_t groupId = get_group_id(0);
     int localSize = get_local_size(0);
     
     locarr[localId] = arr[globalId];
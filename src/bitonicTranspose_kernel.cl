@@ -0,0 +1,75 @@
+#ifndef index_t
+#define index_t int
+#endif
+
+#ifndef key_t
+#define key_t int
+#endif
+
+#ifdef key_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+// Square tile transpose through local memory: src is rows x cols, dst is
+// cols x rows. NDRange(cols, rows) with square local size, tile holds
+// tileSize * (tileSize + 1) keys (padding avoids bank conflicts).
+__kernel void transpose_kernel(__global const key_t* src,
+                         __global key_t* dst,
+                         index_t rows,
+                         index_t cols,
+                         __local key_t* tile)
+{
+    int tileSize = get_local_size(0);
+    
+    int lx = get_local_id(0);
+    int ly = get_local_id(1);
+    
+    index_t gx = get_group_id(0) * tileSize;
+    index_t gy = get_group_id(1) * tileSize;
+    
+    tile[ly * (tileSize + 1) + lx] = src[(gy + ly) * cols + gx + lx];
+    
+    barrier(CLK_LOCAL_MEM_FENCE);
+    
+    dst[(gx + ly) * rows + gy + lx] = tile[lx * (tileSize + 1) + ly];
+}
+
+void compareAndSwap_merge(__local key_t* arr, int i, int j, int dir) {
+    if ((arr[i] > arr[j] && dir == 1) || (arr[i] < arr[j] && dir == 0)) {
+        key_t temp = arr[i];
+        arr[i] = arr[j];
+        arr[j] = temp;
+    }
+}
+
+// Tail of a bitonic merge in local memory: substages from subStageStart down
+// to 1. Pair direction is ascending when (globalId & dirMask) == 0, which
+// lets the same kernel run on the plain and on the transposed layout.
+__kernel void bitonicMerge_lkernel(__global key_t* arr,
+                             index_t dirMask,
+                             int subStageStart,
+                             __local key_t* locarr)
+{
+    index_t globalId = get_global_id(0);
+    int localId = get_local_id(0);
+    
+    locarr[localId] = arr[globalId];
+    
+    barrier(CLK_LOCAL_MEM_FENCE);
+    
+    int dir = (globalId & dirMask) == 0;
+    
+    for (int subStage = subStageStart; subStage > 0; subStage /= 2)
+    {
+        int l = localId ^ subStage;
+        
+        if (l > localId)
+        {
+            compareAndSwap_merge(locarr, localId, l, dir);
+        }
+        
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    
+    arr[globalId] = locarr[localId];
+}
@@ -5,25 +5,100 @@
 #include <stdexcept>
 #include <vector>
 #include <string>
+#include <optional>
+#include <filesystem>
+#include <cstdlib>
 
 #include <chrono>
+#include <iomanip>
 #include <cxxopts.hpp>
+#include <fcntl.h>
+#include <unistd.h>
 
 
+struct Output
+{
+    std::optional<std::string> file;
+    bool delta = false;
+};
+
+// Where the profile of a sort goes: the stage table and/or the bandwidth of
+// every kernel against the device peak (bytes per second) on stderr, and/or
+// a Chrome trace file
+struct ProfileOutput
+{
+    bool table = false;
+    std::optional<double> peakBandwidth;
+    std::optional<std::string> traceFile;
+};
+
+// Destination of sorted keys that arrive block by block: a binary file
+// written front to back, or text on stdout
+class SortedStream
+{
+    std::optional<bs::BinaryStreamWriter<int>> writer;
+    size_t total = 0;
+
+public:
+    explicit SortedStream(const Output& output);
+
+    void operator()(const int* keys, size_t n);
+    void finish();
+};
+
+std::string sortName(const bs::SortConfig& config);
 void prepareSequenceForBS(std::vector<int>& sequence);
-void showBitonicSort(std::vector<int>& sequence, const cl::Device& device, const std::string& kernelSource, const size_t initial_size);
-void compare(std::vector<int>& sequence, const cl::Device& device, const std::string& kernelSource);
+template <typename T>
+void printSequence(const T* keys, size_t n);
+void writeSorted(const int* keys, size_t n, const Output& output);
+void showBitonicSort(std::vector<int>& sequence, const cl::Device& device, const std::string& kernelSource, const size_t initial_size,
+                     const bs::SortConfig& config, const Output& output);
+void sortBinary(const bs::BinaryReader& input, const cl::Device& device, const std::string& kernelSource,
+                const bs::SortConfig& config, const Output& output);
+void sortNpy(const bs::NpyReader& input, const cl::Device& device, const std::string& kernelSource,
+             const bs::SortConfig& config, const Output& output);
+void sortRows(const std::string& fileName, size_t column, const std::string& delimiter, bool header,
+              const cl::Device& device, const std::string& kernelSource, const bs::SortConfig& config, const Output& output);
+void sortExternal(const std::optional<std::string>& inputFile, const cl::Device& device, const std::string& kernelSource,
+                  const bs::SortConfig& config, const Output& output, size_t budgetBytes, const std::string& tempDir);
+void mergeSorted(const std::vector<std::string>& inputFiles, const Output& output, size_t budgetBytes);
+void compare(const std::vector<int>& sequence, const cl::Device& device, const std::string& kernelSource,
+             const bs::SortConfig& config, size_t warmup, size_t repeat);
+void reportProfile(const bs::SortConfig& config, const ProfileOutput& profileOutput);
 
 int main(int argc, const char* argv[]) try 
 {
     cxxopts::Options options("biton", "Bitonic sort using OpenCL");
+    options.positional_help("[sorted binary files of --merge]");
     options.add_options()
-        ("f,file", "Input file with numbers to sort", cxxopts::value<std::string>())
-        ("c,compare", "Compare with std::sort")
+        ("f,file", "Input file with numbers to sort (text, binary or .npy)", cxxopts::value<std::string>())
+        ("o,output", "Write the sorted sequence to a binary file (.npy for .npy input)", cxxopts::value<std::string>())
+        ("delta", "Encode --output as blocks of zigzag varint deltas with an index")
+        ("c,compare", "Compare with std::sort and parallel std::sort")
+        ("verify", "Check on the device that the sorted keys are in order and a permutation of the input (one extra pass)")
+        ("warmup", "Untimed runs of every sort in --compare after the cold one", cxxopts::value<size_t>()->default_value("1"))
+        ("repeat", "Timed warm runs of every sort in --compare", cxxopts::value<size_t>()->default_value("5"))
+        ("profile", "Print device times of transfers, network stages and program builds")
+        ("trace", "Write a Chrome trace (Perfetto) of host phases and device commands to this JSON file", cxxopts::value<std::string>())
+        ("roofline", "Print the bandwidth of every kernel as a share of the device peak (measured once by a copy kernel and cached)")
+        ("stats", "Print the hot path counters on exit: launches, transfers, queue finishes, builds, allocations (needs -DBS_COUNTERS=ON)")
         ("h,help", "Print usage")
         ("dev", "Show selected OpenCL device")
         ("shdevs", "Show all available OpenCL devices")
-        ("s,select", "Select device by platform and device index (format: <platformIdx>:<deviceIdx>)", cxxopts::value<std::string>()->default_value("auto"));
+        ("s,select", "Select device by platform and device index (format: <platformIdx>:<deviceIdx>)", cxxopts::value<std::string>()->default_value("auto"))
+        ("n,network", "Sorting network (bitonic, oddeven)", cxxopts::value<std::string>()->default_value("bitonic"))
+        ("e,engine", "Sorting engine (network, radix)", cxxopts::value<std::string>()->default_value("network"))
+        ("t,transposed", "Run large-stride bitonic substages on a transposed layout")
+        ("stream", "Sort stdin chunk by chunk while it is being read")
+        ("no-count", "--stream input has no count header, every number is a key")
+        ("inplace", "Sort a binary file in place", cxxopts::value<std::string>())
+        ("external", "Sort input larger than RAM by spilling sorted runs to disk")
+        ("merge", "Merge the binary files given as arguments, each already sorted")
+        ("k,key-column", "Sort the rows of a delimited text --file by this integer column (1-based)", cxxopts::value<size_t>())
+        ("delimiter", "Column delimiter of --key-column, tab for TSV", cxxopts::value<std::string>()->default_value(","))
+        ("header", "Keep the first row of --key-column input on top")
+        ("budget", "Host memory budget of --external and --merge in MiB", cxxopts::value<size_t>()->default_value("1024"))
+        ("tmpdir", "Directory for the runs spilled by --external (default: system temp)", cxxopts::value<std::string>()->default_value(""));
 
 
     auto result = options.parse(argc, argv);
@@ -33,12 +108,92 @@ int main(int argc, const char* argv[]) try
       exit(0);
     }
 
+    bs::SortConfig config;
+    config.engine  = bs::parseEngine(result["engine"].as<std::string>());
+    config.network = bs::parseNetwork(result["network"].as<std::string>());
+    config.transposed = result.count("transposed");
+    config.verify = result.count("verify");
+
+    // Positional arguments are the inputs of --merge and nothing else
+    if (not result.count("merge") && not result.unmatched().empty())
+        throw std::invalid_argument("Unexpected argument: " + result.unmatched().front());
+
+    if (result.count("merge") && result.unmatched().empty())
+        throw std::invalid_argument("--merge expects the sorted binary files to merge");
+
+    if (result.count("stream") && result.count("file"))
+        throw std::invalid_argument("--stream sorts stdin and cannot be combined with --file");
+
+    if (result.count("no-count") && not result.count("stream"))
+        throw std::invalid_argument("--no-count applies to --stream input only");
+
+    if (config.verify && (result.count("stream") || result.count("external") || result.count("inplace") || result.count("merge")))
+        throw std::invalid_argument("--verify is available for sorts of a whole sequence in memory");
+
+    // The counters cover every mode, so they are printed on any exit
+    if (result.count("stats"))
+    {
+        if (!bs::countersEnabled)
+            throw std::invalid_argument("--stats needs bs_lib built with -DBS_COUNTERS=ON");
+
+        std::atexit([] { bs::reportCounters(std::cerr); });
+    }
+
+    bs::Profile profile;
+    ProfileOutput profileOutput;
+
+    if (result.count("profile") || result.count("trace") || result.count("roofline"))
+    {
+        if (result.count("stream") || result.count("external") || result.count("inplace") || result.count("merge"))
+            throw std::invalid_argument("--profile, --trace and --roofline are available for sorts of a whole sequence in memory");
+
+        config.profile = &profile;
+        profileOutput.table = result.count("profile");
+
+        if (result.count("trace"))
+            profileOutput.traceFile = result["trace"].as<std::string>();
+    }
+
     std::vector<int> sequence;
+    std::optional<bs::BinaryReader> binaryInput;
+    std::optional<bs::NpyReader> npyInput;
+    Output output;
 
+    if (result.count("output"))
+    {
+        output.file = result["output"].as<std::string>();
+        output.delta = result.count("delta");
+    }
 
-    if (result.count("file"))
+    // Merging only reads sorted files, no device is involved
+    if (result.count("merge"))
     {
-        sequence = bs::input_fstream<int>(result["file"].as<std::string>());
+        mergeSorted(result.unmatched(), output, result["budget"].as<size_t>() << 20);
+        exit(0);
+    }
+
+    if (result.count("file") && not result.count("external") && not result.count("key-column"))
+    {
+        std::string fileName = result["file"].as<std::string>();
+
+        bool binary = bs::isBinaryFile(fileName);
+        bool npy = !binary && bs::isNpyFile(fileName);
+
+        if ((binary || npy) && output.file && std::filesystem::exists(*output.file) && 
+            std::filesystem::equivalent(fileName, *output.file))
+        {
+            throw std::runtime_error("Output file must differ from the input file");
+        }
+
+        if (binary)
+            binaryInput.emplace(fileName);
+        else if (npy)
+            npyInput.emplace(fileName);
+        else
+        {
+            bs::HostSpan span(config.profile, "parse");
+            sequence = bs::input_fstream<int>(fileName);
+        }
     }
 
 
@@ -77,28 +232,122 @@ int main(int argc, const char* argv[]) try
     }
 
 
+    std::string kernelSource = bs::readKernel("src/bitonicSort_gkernel.cl")  + 
+                               bs::readKernel("src/bitonicSort_lkernel.cl")  +
+                               bs::readKernel("src/bitonicSort_ckernel.cl")  +
+                               bs::readKernel("src/oddEvenMerge_gkernel.cl") +
+                               bs::readKernel("src/oddEvenMerge_lkernel.cl") +
+                               bs::readKernel("src/radixBucket_kernel.cl")   +
+                               bs::readKernel("src/bitonicTranspose_kernel.cl") +
+                               bs::readKernel("src/bandwidth_kernel.cl") +
+                               bs::readKernel("src/verify_kernel.cl");
+
+    if (result.count("roofline"))
+        profileOutput.peakBandwidth = bs::peakBandwidth(device, kernelSource);
+
+    if (result.count("external"))
+    {
+        std::optional<std::string> inputFile;
+
+        if (result.count("file"))
+            inputFile = result["file"].as<std::string>();
+
+        sortExternal(inputFile, device, kernelSource, config, output, 
+                     result["budget"].as<size_t>() << 20, result["tmpdir"].as<std::string>());
+        exit(0);
+    }
+
+    if (result.count("key-column"))
+    {
+        if (not result.count("file"))
+            throw std::invalid_argument("--key-column sorts the rows of a --file");
+
+        sortRows(result["file"].as<std::string>(), result["key-column"].as<size_t>(), result["delimiter"].as<std::string>(),
+                 result.count("header"), device, kernelSource, config, output);
+        reportProfile(config, profileOutput);
+        exit(0);
+    }
+
+    if (result.count("inplace"))
+    {
+        bs::BinaryReader file(result["inplace"].as<std::string>(), true, true);
+
+        if (!file.sorted())
+        {
+            bs::sortInBlocks(file.mutableKeys<int>(), file.count(), device, kernelSource, config, 
+                             bs::deviceBlockSize(device));
+            file.markSorted();
+        }
+
+        exit(0);
+    }
+
+    if (result.count("stream"))
+    {
+        bs::AsyncReadBuf input(STDIN_FILENO);
+        std::vector<int> sorted = bs::streamSort<int>(&input, device, kernelSource, config, not result.count("no-count"));
+
+        if (!sorted.empty() || output.file)
+            writeSorted(sorted.data(), sorted.size(), output);
+
+        exit(0);
+    }
+
     if (not result.count("file"))
     {
+        bs::HostSpan span(config.profile, "parse");
         sequence = bs::input_stdin<int>();
     }
 
+    if (npyInput)
+    {
+        if (result.count("compare"))
+            throw std::invalid_argument("--compare is not available for .npy input");
+
+        sortNpy(*npyInput, device, kernelSource, config, output);
+        reportProfile(config, profileOutput);
+        exit(0);
+    }
+
+    if (binaryInput)
+    {
+        if (not result.count("compare"))
+        {
+            sortBinary(*binaryInput, device, kernelSource, config, output);
+            reportProfile(config, profileOutput);
+            exit(0);
+        }
+
+        const int* keys = binaryInput->keys<int>();
+        sequence.assign(keys, keys + binaryInput->count());
+    }
+
     size_t initial_size = sequence.size();
 
-    std::string kernelSource = bs::readKernel("src/bitonicSort_gkernel.cl") + 
-                               bs::readKernel("src/bitonicSort_lkernel.cl");
-    
     if (!sequence.empty())
     {
-        prepareSequenceForBS(sequence);
-        
+        // Every sort of the comparison gets the keys as they were read, the
+        // device pads them itself
         if(result.count("compare"))
         {
-            std::vector<int> duplicate = sequence;
-            compare(duplicate, device, kernelSource);
+            size_t repeat = result["repeat"].as<size_t>();
+
+            if (repeat == 0)
+                throw std::invalid_argument("--repeat must be positive");
+
+            compare(sequence, device, kernelSource, config, result["warmup"].as<size_t>(), repeat);
+            reportProfile(config, profileOutput);
             exit(0);
         }
 
-        showBitonicSort(sequence, device, kernelSource, initial_size);
+        if (config.engine == bs::Engine::Network)
+        {
+            bs::HostSpan span(config.profile, "pad");
+            prepareSequenceForBS(sequence);
+        }
+
+        showBitonicSort(sequence, device, kernelSource, initial_size, config, output);
+        reportProfile(config, profileOutput);
     }
     
 }
@@ -111,6 +360,14 @@ catch (...)
     std::cout << "Unknown problems occurred\n";
 }
 
+std::string sortName(const bs::SortConfig& config)
+{
+    if (config.engine == bs::Engine::RadixBucket)
+        return "Radix bucket sort";
+
+    return (config.network == bs::Network::Bitonic) ? "Bitonic sort" : "Odd-even merge sort";
+}
+
 void prepareSequenceForBS(std::vector<int>& sequence)
 {
     size_t sequence_size = sequence.size();
@@ -126,33 +383,443 @@ void prepareSequenceForBS(std::vector<int>& sequence)
     }
 }
 
+template <typename T>
+void printSequence(const T* keys, size_t n)
+{
+    std::cout.flush();
+
+    bs::writeText(STDOUT_FILENO, keys, n);
+}
+
 void showBitonicSort(std::vector<int>& sequence,
                      const cl::Device& device, 
                      const std::string& kernelSource, 
-                     const size_t initial_size)
+                     const size_t initial_size,
+                     const bs::SortConfig& config,
+                     const Output& output)
+{
+    bs::sort(sequence, device, kernelSource, config);
+
+    bs::HostSpan span(config.profile, output.file ? "write" : "format+write");
+    writeSorted(sequence.data(), initial_size, output);
+}
+
+void writeSorted(const int* keys, size_t n, const Output& output)
+{
+    if (output.file && output.delta)
+        bs::writeDelta(*output.file, keys, n);
+    else if (output.file)
+        bs::writeBinary(*output.file, keys, n, true);
+    else
+        printSequence(keys, n);
+}
+
+// Keys are uploaded straight from the input mapping and, with --output, read
+// back straight into the mapping of the output file. Input already flagged
+// as sorted is copied through.
+void sortBinary(const bs::BinaryReader& input,
+                const cl::Device& device,
+                const std::string& kernelSource,
+                const bs::SortConfig& config,
+                const Output& output)
 {
-    bs::bitonicSort_modernized(sequence, device, kernelSource);
+    const int* keys = input.keys<int>();
+    size_t n = input.count();
+
+    if (output.file && !output.delta)
+    {
+        bs::BinaryWriter<int> writer(*output.file, n);
 
-    for (size_t i = 0; i < initial_size; i++) std::cout << sequence[i] << " ";
+        if (input.sorted())
+            std::copy_n(keys, n, writer.keys());
+        else
+            bs::sort(keys, writer.keys(), n, device, kernelSource, config);
 
-    std::cout << '\n';
+        bs::HostSpan span(config.profile, "write");
+        writer.finish(true);
+        return;
+    }
+
+    if (n == 0 && !output.file)
+        return;
+
+    std::vector<int> sorted(n);
+
+    if (input.sorted())
+        std::copy_n(keys, n, sorted.data());
+    else
+        bs::sort(keys, sorted.data(), n, device, kernelSource, config);
+
+    bs::HostSpan span(config.profile, output.file ? "write" : "format+write");
+    writeSorted(sorted.data(), n, output);
 }
 
-void compare(std::vector<int>& sequence, const cl::Device& device, const std::string& kernelSource)
+// The dtype of the array selects the key type the kernels are built for.
+// Keys go to the device straight from the input mapping and come back
+// straight into the mapping of the output .npy file.
+void sortNpy(const bs::NpyReader& input,
+             const cl::Device& device,
+             const std::string& kernelSource,
+             const bs::SortConfig& config,
+             const Output& output)
 {
-    std::vector<int> sequence2 = sequence;
+    if (output.delta)
+        throw std::invalid_argument("--delta is not available for .npy input");
+
+    bs::dispatchNpyDtype(input.dtype(), [&]<typename T>(std::type_identity<T>)
+    {
+        size_t n = input.count();
+
+        if (output.file)
+        {
+            bs::NpyWriter<T> writer(*output.file, n);
+            bs::sort(input.keys<T>(), writer.keys(), n, device, kernelSource, config);
+            return;
+        }
 
-    auto start1 = std::chrono::high_resolution_clock::now();
-    bs::bitonicSort_modernized(sequence, device, kernelSource);
-    auto end1 = std::chrono::high_resolution_clock::now();
+        if (n == 0)
+            return;
 
-    auto start2 = std::chrono::high_resolution_clock::now();
-    bs::stdSort(sequence2);
-    auto end2 = std::chrono::high_resolution_clock::now();
+        std::vector<T> sorted(n);
+        bs::sort(input.keys<T>(), sorted.data(), n, device, kernelSource, config);
+
+        bs::HostSpan span(config.profile, "format+write");
+        printSequence(sorted.data(), n);
+    });
+}
+
+// Text input is parsed block by block, read ahead through io_uring, and
+// binary input is read from its mapping, so neither is ever held in memory
+// as a whole. The count header of text input is required as in the
+// in-memory path.
+void sortExternal(const std::optional<std::string>& inputFile,
+                  const cl::Device& device,
+                  const std::string& kernelSource,
+                  const bs::SortConfig& config,
+                  const Output& output,
+                  size_t budgetBytes,
+                  const std::string& tempDir)
+{
+    if (output.delta)
+        throw std::invalid_argument("--delta encodes the whole sequence in memory and is not available with --external");
 
-    std::chrono::duration<double> diff1 = end1 - start1;
-    std::chrono::duration<double> diff2 = end2 - start2;
+    std::filesystem::path tempParent = tempDir.empty() ? std::filesystem::temp_directory_path() 
+                                                       : std::filesystem::path(tempDir);
 
-    std::cout << "Bitonic sort: " << diff1.count() << " s\n";
-    std::cout << "std::sort: " << diff2.count() << " s\n";
+    std::optional<bs::BinaryReader> binaryInput;
+    std::optional<bs::AsyncReadBuf> textInput;
+
+    if (inputFile && bs::isBinaryFile(*inputFile))
+    {
+        // The checksum pass would read a larger than RAM file twice
+        binaryInput.emplace(*inputFile, false);
+    }
+    else if (inputFile)
+    {
+        textInput.emplace(*inputFile);
+    }
+    else
+    {
+        textInput.emplace(STDIN_FILENO);
+    }
+
+    bs::StreamParser<int> parser(binaryInput ? nullptr : &*textInput);
+    size_t remaining = 0;
+    size_t expected = 0;
+
+    if (binaryInput)
+    {
+        remaining = binaryInput->count();
+    }
+    else
+    {
+        long long count = 0;
+
+        if (parser.next(&count, 1) != 1)
+            throw std::runtime_error("Invalid file format. Expected a number at the beginning.");
+
+        if (count < 0)
+            throw std::runtime_error("Number of elements must be non-negative");
+
+        remaining = static_cast<size_t>(count);
+    }
+
+    expected = remaining;
+
+    auto source = [&](int* keys, size_t n)
+    {
+        size_t wanted = std::min(n, remaining);
+
+        if (binaryInput)
+        {
+            std::copy_n(binaryInput->keys<int>() + (expected - remaining), wanted, keys);
+        }
+        else if (parser.next(keys, wanted) != wanted)
+        {
+            throw std::runtime_error("File contains fewer numbers than specified. Expected: " + 
+                                     std::to_string(expected) + ", got: " + std::to_string(parser.itemsRead() - 1));
+        }
+
+        remaining -= wanted;
+
+        return wanted;
+    };
+
+    SortedStream sink(output);
+
+    bs::externalSort<int>(source, sink, device, kernelSource, config, budgetBytes, tempParent);
+
+    sink.finish();
+}
+
+// Rows of a delimited file ordered by an integer column: the key column is
+// parsed in parallel from the mapping, argsorted on the device, and the rows
+// are gathered from the mapping straight into writev. Equal keys keep the
+// order of their rows, as with sort -s.
+void sortRows(const std::string& fileName,
+              size_t column,
+              const std::string& delimiter,
+              bool header,
+              const cl::Device& device,
+              const std::string& kernelSource,
+              const bs::SortConfig& config,
+              const Output& output)
+{
+    if (output.delta)
+        throw std::invalid_argument("--delta is not available with --key-column");
+
+    if (column == 0)
+        throw std::invalid_argument("--key-column counts columns from 1");
+
+    char separator = '\t';
+
+    if (delimiter != "tab" && delimiter != "\\t")
+    {
+        if (delimiter.size() != 1)
+            throw std::invalid_argument("--delimiter must be a single character or tab");
+
+        separator = delimiter.front();
+    }
+
+    if (output.file && std::filesystem::exists(*output.file) && std::filesystem::equivalent(fileName, *output.file))
+        throw std::runtime_error("Output file must differ from the input file");
+
+    bs::MappedFile file(fileName);
+    std::string_view text = file.view();
+    std::string_view headerRow;
+
+    if (header)
+    {
+        headerRow = text.substr(0, std::min(text.find('\n'), text.size() - 1) + 1);
+        text.remove_prefix(headerRow.size());
+    }
+
+    bs::KeyColumn keys = [&]
+    {
+        bs::HostSpan span(config.profile, "parse");
+        return bs::parseKeyColumn(text, column - 1, separator);
+    }();
+    std::vector<uint32_t> order = bs::argsort(keys.keys.data(), keys.keys.size(), device, kernelSource, config);
+
+    int fd = STDOUT_FILENO;
+
+    if (output.file)
+    {
+        fd = ::open(output.file->c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if (fd < 0)
+            throw std::runtime_error("Failed to create file: " + *output.file);
+    }
+    else
+    {
+        std::cout.flush();
+    }
+
+    try
+    {
+        bs::HostSpan span(config.profile, "write");
+        std::vector<iovec> parts{{const_cast<char*>(headerRow.data()), headerRow.size()}};
+
+        bs::writeAll(fd, parts);
+        bs::writeRows(fd, keys, order.data(), order.size());
+    }
+    catch (...)
+    {
+        if (output.file)
+            ::close(fd);
+        throw;
+    }
+
+    if (output.file)
+        ::close(fd);
+}
+
+// k-way merge of binary files that carry the sorted flag, nothing is sorted
+// again. The budget is split between one read block per input and the
+// output block.
+void mergeSorted(const std::vector<std::string>& inputFiles, const Output& output, size_t budgetBytes)
+{
+    if (output.delta)
+        throw std::invalid_argument("--delta encodes the whole sequence in memory and is not available with --merge");
+
+    for (const auto& inputFile : inputFiles)
+    {
+        if (!bs::isBinaryFile(inputFile))
+            throw std::runtime_error("--merge takes binary files only: " + inputFile);
+
+        if (output.file && std::filesystem::exists(*output.file) && std::filesystem::equivalent(inputFile, *output.file))
+            throw std::runtime_error("Output file must differ from the input files");
+    }
+
+    size_t blockKeys = std::clamp<size_t>(budgetBytes / sizeof(int) / (inputFiles.size() + 1), 1024, 1 << 18);
+
+    SortedStream sink(output);
+
+    bs::mergeRuns<int>(inputFiles, blockKeys, sink);
+
+    sink.finish();
+}
+
+SortedStream::SortedStream(const Output& output)
+{
+    if (output.file)
+        writer.emplace(*output.file);
+    else
+        std::cout.flush();
+}
+
+void SortedStream::operator()(const int* keys, size_t n)
+{
+    total += n;
+
+    if (writer)
+        writer->append(keys, n);
+    else
+        bs::writeTextBlock(STDOUT_FILENO, keys, n);
+}
+
+void SortedStream::finish()
+{
+    if (writer)
+        writer->finish(true);
+    else if (total > 0)
+        std::cout << '\n';
+}
+
+// Cold run and summary of the warm runs of one sort
+struct CompareResult
+{
+    std::string name;
+    double      cold = 0;
+    bs::Timings warm;
+};
+
+// Runs sortKeys on a fresh copy of sequence 1 + warmup + repeat times, the
+// copy is made outside the timed region. The first run is cold: the device
+// program is compiled by the driver for the first time, the sorted buffer
+// and the thread pool of the parallel std::sort are new. The last repeat
+// runs are timed as warm. Every result must equal expected.
+template <typename Sort>
+CompareResult timeRuns(std::string name, const std::vector<int>& sequence, const std::vector<int>& expected,
+                       size_t warmup, size_t repeat, Sort sortKeys)
+{
+    CompareResult result;
+    result.name = std::move(name);
+    std::vector<double> samples;
+    std::vector<int> keys;
+
+    for (size_t run = 0; run < 1 + warmup + repeat; ++run)
+    {
+        keys = sequence;
+
+        auto start = std::chrono::steady_clock::now();
+        sortKeys(keys, run == 0);
+        auto end = std::chrono::steady_clock::now();
+
+        if (keys != expected)
+            throw std::runtime_error(result.name + " result differs from std::sort");
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+
+        if (run == 0)
+            result.cold = seconds;
+        else if (run > warmup)
+            samples.push_back(seconds);
+    }
+
+    result.warm = bs::summarize(std::move(samples));
+
+    return result;
+}
+
+// The device sort is timed whole, as biton runs it: context, program build,
+// upload, kernels and readback. A profile only records its cold run.
+void compare(const std::vector<int>& sequence, const cl::Device& device, const std::string& kernelSource,
+             const bs::SortConfig& config, size_t warmup, size_t repeat)
+{
+    std::vector<int> expected = sequence;
+    bs::stdSort(expected);
+
+    bs::SortConfig warmConfig = config;
+    warmConfig.profile = nullptr;
+
+    std::vector<CompareResult> results;
+
+    results.push_back(timeRuns(sortName(config), sequence, expected, warmup, repeat, [&](std::vector<int>& keys, bool cold)
+    {
+        bs::sort(keys, device, kernelSource, cold ? config : warmConfig);
+    }));
+
+    results.push_back(timeRuns("std::sort", sequence, expected, warmup, repeat, [](std::vector<int>& keys, bool)
+    {
+        bs::stdSort(keys);
+    }));
+
+    results.push_back(timeRuns("std::sort(par)", sequence, expected, warmup, repeat, [](std::vector<int>& keys, bool)
+    {
+        bs::stdSortParallel(keys);
+    }));
+
+    std::cout << sequence.size() << " keys, " << warmup << " warmup and " << repeat << " timed runs\n"
+              << std::left << std::setw(24) << "sort" << std::right << std::setw(12) << "cold, s"
+              << std::setw(12) << "median, s" << std::setw(12) << "stddev, s" << std::setw(12) << "Mkeys/s" << '\n'
+              << std::fixed << std::setprecision(6);
+
+    for (const auto& result : results)
+        std::cout << std::left << std::setw(24) << result.name << std::right << std::setw(12) << result.cold
+                  << std::setw(12) << result.warm.median << std::setw(12) << result.warm.stddev
+                  << std::setprecision(2) << std::setw(12) << sequence.size() / result.warm.median / 1e6
+                  << std::setprecision(6) << '\n';
+
+    std::cout << std::defaultfloat;
+}
+
+// The table goes to stderr, stdout may carry the sorted keys
+void reportProfile(const bs::SortConfig& config, const ProfileOutput& profileOutput)
+{
+    if (!config.profile)
+        return;
+
+    if (profileOutput.table)
+    {
+        std::cerr << "Profile of " << sortName(config) << ":\n";
+        config.profile->report(std::cerr);
+    }
+
+    if (profileOutput.peakBandwidth)
+    {
+        std::cerr << "Bandwidth of " << sortName(config) << " kernels, peak " << std::fixed << std::setprecision(2)
+                  << *profileOutput.peakBandwidth / 1e9 << " GB/s:\n" << std::defaultfloat;
+        config.profile->roofline(std::cerr, *profileOutput.peakBandwidth);
+    }
+
+    if (profileOutput.traceFile)
+    {
+        std::ofstream trace(*profileOutput.traceFile);
+
+        if (!trace)
+            throw std::runtime_error("Failed to create file: " + *profileOutput.traceFile);
+
+        config.profile->writeTrace(trace);
+    }
 }
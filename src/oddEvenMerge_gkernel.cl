@@ -0,0 +1,46 @@
+#ifndef index_t
+#define index_t int
+#endif
+
+#ifndef key_t
+#define key_t int
+#endif
+
+#ifdef key_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+void compareAndSwap_oem_global(__global key_t* arr, index_t i, index_t j, int dir) {
+    if ((arr[i] > arr[j] && dir == 1) || (arr[i] < arr[j] && dir == 0)) {
+        key_t temp = arr[i];
+        arr[i] = arr[j];
+        arr[j] = temp;
+    }
+}
+
+// One work item per comparator (n / 2 items). Stage and subStage have the
+// same meaning as in bitonicStep_gkernel: size of the merged blocks and
+// distance between compared elements.
+__kernel void oddEvenMergeStep_gkernel(__global key_t* arr, 
+                                 index_t stage,
+                                 index_t subStage,
+                                 int dir)
+{
+    index_t comparatorId = get_global_id(0);
+    
+    index_t pos = 2 * comparatorId - (comparatorId & (subStage - 1));
+    
+    if (subStage < stage / 2)
+    {
+        index_t offset = comparatorId & (stage / 2 - 1);
+        
+        if (offset >= subStage)
+        {
+            compareAndSwap_oem_global(arr, pos - subStage, pos, dir);
+        }
+    }
+    else
+    {
+        compareAndSwap_oem_global(arr, pos, pos + subStage, dir);
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef index_t
+#define index_t int
+#endif
+
+#ifndef key_t
+#define key_t int
+#endif
+
+#ifdef key_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+void compareAndSwap_oem_local(__local key_t* arr, int i, int j) {
+    if (arr[i] > arr[j]) {
+        key_t temp = arr[i];
+        arr[i] = arr[j];
+        arr[j] = temp;
+    }
+}
+
+// Work group of stage / 2 items merges one block of stage elements, every
+// item loads two elements and owns one comparator per substage.
+__kernel void oddEvenMergeStep_lkernel(__global key_t* arr, 
+                                 index_t stage,
+                                 __local key_t* locarr,
+                                 index_t n)
+{
+    int localId = get_local_id(0);
+    index_t groupId = get_group_id(0);
+    int localSize = get_local_size(0);
+    
+    index_t base = groupId * stage;
+    
+    locarr[localId] = arr[base + localId];
+    locarr[localId + localSize] = arr[base + localId + localSize];
+    
+    barrier(CLK_LOCAL_MEM_FENCE);
+    
+    for (int subStage = stage / 2; subStage > 0; subStage /= 2)
+    {
+        int pos = 2 * localId - (localId & (subStage - 1));
+        
+        if (subStage < stage / 2)
+        {
+            int offset = localId & (stage / 2 - 1);
+            
+            if (offset >= subStage)
+            {
+                compareAndSwap_oem_local(locarr, pos - subStage, pos);
+            }
+        }
+        else
+        {
+            compareAndSwap_oem_local(locarr, pos, pos + subStage);
+        }
+        
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    
+    arr[base + localId] = locarr[localId];
+    arr[base + localId + localSize] = locarr[localId + localSize];
+}
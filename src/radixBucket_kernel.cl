@@ -0,0 +1,144 @@
+uint bucketOf(int key, int minKey, int shift) {
+    return ((uint)key - (uint)minKey) >> shift;
+}
+
+__kernel void radixHistogram_kernel(__global const int* arr,
+                              __global uint* histogram,
+                              int minKey,
+                              int shift)
+{
+    int i = get_global_id(0);
+    
+    atomic_inc(&histogram[bucketOf(arr[i], minKey, shift)]);
+}
+
+// Cursor starts at the exclusive prefix sum of the histogram, order inside
+// a bucket is arbitrary
+__kernel void radixScatter_kernel(__global const int* arr,
+                            __global int* out,
+                            __global uint* cursor,
+                            int minKey,
+                            int shift)
+{
+    int i = get_global_id(0);
+    
+    int key = arr[i];
+    uint pos = atomic_inc(&cursor[bucketOf(key, minKey, shift)]);
+    
+    out[pos] = key;
+}
+
+// Bucket of the key at position i on a refinement level. The old bucket is
+// found by binary search over the old offsets, old bucket b is split into
+// firstChild[b + 1] - firstChild[b] children (a power of two, 1 keeps it
+// whole) by the bits of (key - minKey) from childShift[b] up.
+uint refinedBucket(__global const uint* offsets,
+                   uint oldCount,
+                   __global const uint* firstChild,
+                   __global const int* childShift,
+                   uint i,
+                   int key,
+                   int minKey)
+{
+    uint lo = 0;
+    uint hi = oldCount;
+
+    while (hi - lo > 1)
+    {
+        uint mid = (lo + hi) / 2;
+
+        if (offsets[mid] <= i)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    uint children = firstChild[lo + 1] - firstChild[lo];
+
+    return firstChild[lo] + ((((uint)key - (uint)minKey) >> childShift[lo]) & (children - 1));
+}
+
+__kernel void refineHistogram_kernel(__global const int* arr,
+                             __global const uint* offsets,
+                             uint oldCount,
+                             __global const uint* firstChild,
+                             __global const int* childShift,
+                             __global uint* histogram,
+                             int minKey)
+{
+    uint i = get_global_id(0);
+
+    atomic_inc(&histogram[refinedBucket(offsets, oldCount, firstChild, childShift, i, arr[i], minKey)]);
+}
+
+// Same as radixScatter_kernel, buckets that are not split land where they were
+__kernel void refineScatter_kernel(__global const int* arr,
+                           __global int* out,
+                           __global const uint* offsets,
+                           uint oldCount,
+                           __global const uint* firstChild,
+                           __global const int* childShift,
+                           __global uint* cursor,
+                           int minKey)
+{
+    uint i = get_global_id(0);
+
+    int key = arr[i];
+    uint pos = atomic_inc(&cursor[refinedBucket(offsets, oldCount, firstChild, childShift, i, key, minKey)]);
+
+    out[pos] = key;
+}
+
+void compareAndSwap_bucket(__local int* arr, int i, int j, int dir) {
+    if ((arr[i] > arr[j] && dir == 1) || (arr[i] < arr[j] && dir == 0)) {
+        int temp = arr[i];
+        arr[i] = arr[j];
+        arr[j] = temp;
+    }
+}
+
+// One work group per bucket: the bucket is padded with INT_MAX up to the
+// next power of two and fully bitonic sorted in local memory. Buckets larger
+// than the tile are left after refinement only when they hold a single key
+// value.
+__kernel void bucketSort_lkernel(__global int* arr,
+                           __global const uint* bucketOffsets,
+                           __local int* locarr)
+{
+    int localId = get_local_id(0);
+    int groupId = get_group_id(0);
+    int localSize = get_local_size(0);
+    
+    int start = bucketOffsets[groupId];
+    int count = bucketOffsets[groupId + 1] - start;
+    
+    if (count < 2 || count > localSize)
+        return;
+    
+    int sortSize = 2;
+    
+    while (sortSize < count)
+        sortSize *= 2;
+    
+    locarr[localId] = (localId < count) ? arr[start + localId] : INT_MAX;
+    
+    barrier(CLK_LOCAL_MEM_FENCE);
+    
+    for (int stage = 2; stage <= sortSize; stage *= 2)
+    {
+        for (int subStage = stage / 2; subStage > 0; subStage /= 2)
+        {
+            int l = localId ^ subStage;
+            
+            if (l > localId)
+            {
+                compareAndSwap_bucket(locarr, localId, l, (localId & stage) == 0);
+            }
+            
+            barrier(CLK_LOCAL_MEM_FENCE);
+        }
+    }
+    
+    if (localId < count)
+        arr[start + localId] = locarr[localId];
+}
@@ -0,0 +1,83 @@
+// Index type, the host builds with -D index_t=long for sequences over INT_MAX
+#ifndef index_t
+#define index_t int
+#endif
+
+// Key type, built with -D key_t=long (uint, float, double) for typed keys
+#ifndef key_t
+#define key_t int
+#endif
+
+#ifdef key_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+// SplitMix64 of the key bits, so keys that differ in one bit hash far apart
+ulong mixKey_verify(ulong x) {
+    x += 0x9E3779B97F4A7C15UL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9UL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBUL;
+
+    return x ^ (x >> 31);
+}
+
+// One pass over n keys for --verify: every group writes the sum and the xor
+// of the mixed keys it read, which do not depend on the order of the keys,
+// and any work item that sees a key greater than the next one sets unsorted.
+// Work items stride over the keys by the global size, so consecutive items
+// read consecutive keys and a few groups cover any n. The local size is a
+// power of two.
+__kernel void verifyDigest_kernel(__global const key_t* arr,
+                            index_t n,
+                            __global ulong* sums,
+                            __global ulong* xors,
+                            __global uint* unsorted,
+                            __local ulong* localSums,
+                            __local ulong* localXors)
+{
+    size_t lid = get_local_id(0);
+    size_t count = (size_t)n;
+
+    ulong sum = 0;
+    ulong mixed = 0;
+    uint inversion = 0;
+
+    for (size_t i = get_global_id(0); i < count; i += get_global_size(0))
+    {
+        union { key_t key; ulong bits; } key;
+        key.bits = 0;
+        key.key = arr[i];
+
+        ulong hash = mixKey_verify(key.bits);
+        sum += hash;
+        mixed ^= mixKey_verify(hash);
+
+        if (i + 1 < count && arr[i] > arr[i + 1])
+            inversion = 1;
+    }
+
+    if (inversion)
+        *unsorted = 1;
+
+    localSums[lid] = sum;
+    localXors[lid] = mixed;
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (size_t half = get_local_size(0) / 2; half > 0; half /= 2)
+    {
+        if (lid < half)
+        {
+            localSums[lid] += localSums[lid + half];
+            localXors[lid] ^= localXors[lid + half];
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (lid == 0)
+    {
+        sums[get_group_id(0)] = localSums[0];
+        xors[get_group_id(0)] = localXors[0];
+    }
+}
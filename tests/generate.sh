@@ -1,6 +1,15 @@
+#!/bin/bash
+# Regenerates the e2e inputs and answers with the generate target, run from
+# the repository root after `cmake --build build --target generate`
+GENERATE=${GENERATE:-./build/generate}
+DISTRIBUTIONS=(uniform sorted reverse nearly-sorted few-unique zipf all-equal organ-pipe staggered)
 START_INDEX=3
 END_INDEX=20
-for i in $(eval echo {$START_INDEX..$END_INDEX})
+# test1 is the empty input, test2 a small hand-written one
+$GENERATE --count 0 --output tests/e2e/test1.dat --answer tests/e2e/test1.ans
+for i in $(seq $START_INDEX $END_INDEX)
     do
-        /usr/bin/python3 /home/matvey/work/BitonicSort2/tests/randomizer.py tests/e2e/test${i}.dat -100000 100000 $((i * 1301));
-    done
\ No newline at end of file
+        dist=${DISTRIBUTIONS[$(( (i - START_INDEX) % ${#DISTRIBUTIONS[@]} ))]}
+        $GENERATE --count $((i * 1301)) --dist $dist --seed $i \
+                  --output tests/e2e/test${i}.dat --answer tests/e2e/test${i}.ans
+    done
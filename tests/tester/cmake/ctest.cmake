@@ -16,6 +16,8 @@ function (create_tests)
                         "${CTEST_PROGRAM_EXEC}"
                         "${test_input}"
                         "${test_answer}"
+                # biton reads its kernels relative to the source tree
+                WORKING_DIRECTORY "${CMAKE_SOURCE_DIR}"
             )
             set_tests_properties("${test_name}" PROPERTIES
                     TIMEOUT "${CTEST_TIMEOUT}"
@@ -41,3 +43,35 @@ else()
         "No test inputs found in ${CTEST_INPUTS_DIR} with pattern *.${CTEST_INPUT_PATTERN}"
     )
 endif()
+
+
+# Opt-in performance gate: a fresh bench run is compared with the stored
+# baseline, cells that got slower fail the test. Run with ctest -L perf,
+# exclude from a full run with ctest -LE perf.
+if (PERF_GATE)
+    if (EXISTS "${PERF_BASELINE}")
+        set(perf_current "${CMAKE_BINARY_DIR}/bench_current.json")
+
+        add_test(
+            NAME perf_bench
+            COMMAND bench ${PERF_BENCH_ARGS} --json "${perf_current}"
+            WORKING_DIRECTORY "${CMAKE_SOURCE_DIR}"
+        )
+        add_test(
+            NAME perf_regression
+            COMMAND bench_compare "${PERF_BASELINE}" "${perf_current}" --threshold ${PERF_THRESHOLD}
+        )
+        set_tests_properties(perf_bench PROPERTIES
+                LABELS perf
+                FIXTURES_SETUP perf_results
+                TIMEOUT "${PERF_TIMEOUT}"
+        )
+        set_tests_properties(perf_regression PROPERTIES
+                LABELS perf
+                FIXTURES_REQUIRED perf_results
+        )
+        message(STATUS "Added perf gate against ${PERF_BASELINE}")
+    else()
+        message(WARNING "Perf baseline not found: ${PERF_BASELINE}, the perf gate is not added")
+    endif()
+endif()
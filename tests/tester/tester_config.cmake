@@ -1,7 +1,7 @@
 # Tester framework configuration
 
 # CTest
-set(CTEST_PROGRAM_EXEC   "${CMAKE_CURRENT_SOURCE_DIR}/../../build/compare")
+set(CTEST_PROGRAM_EXEC   "${CMAKE_CURRENT_SOURCE_DIR}/../../build/biton")
 set(CTEST_INPUTS_DIR     "${CMAKE_CURRENT_SOURCE_DIR}/../e2e")
 set(CTEST_ANSWERS_DIR    "${CMAKE_CURRENT_SOURCE_DIR}/../e2e")
 
@@ -10,6 +10,15 @@ set(CTEST_ANSWER_PATTERN "ans")
 set(CTEST_PREFIX         "...")
 set(CTEST_TIMEOUT        30)
 
+# Performance gate (ctest -L perf), added with -DPERF_GATE=ON. The baseline
+# is a bench JSON of the same machine, e.g. build/bench.json of an earlier run
+if(NOT DEFINED PERF_BASELINE)
+    set(PERF_BASELINE    "${CMAKE_CURRENT_SOURCE_DIR}/../perf/baseline.json")
+endif()
+set(PERF_BENCH_ARGS      --max-log 22 --repeat 10)
+set(PERF_THRESHOLD       0.05)
+set(PERF_TIMEOUT         3600)
+
 # Gtest
 set(GTEST_DIR "${CMAKE_CURRENT_SOURCE_DIR}/../unit")
 set(GTEST_OUTPUT_EXEC_FILE_NAME "unit_tests")
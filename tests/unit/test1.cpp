@@ -6,6 +6,8 @@
 #include <algorithm>
 #include <sstream>
 #include <fstream>
+#include <filesystem>
+#include <map>
 
 #include "bs.hpp"
 
@@ -111,6 +113,190 @@ TEST(InputFstream, CanReadFromTemporaryFile)
     std::remove(fname);
 }
 
+TEST(InputFstream, ParsesLargeFileInParallelChunks)
+{
+    const char* fname = "test_input_large_tmp.txt";
+
+    std::vector<int> expected(300000);
+    for (size_t i = 0; i < expected.size(); ++i)
+        expected[i] = static_cast<int>(i * 2654435761u);
+
+    {
+        std::ofstream f(fname);
+        f << expected.size() << "\n";
+        for (size_t i = 0; i < expected.size(); ++i)
+            f << expected[i] << (i % 10 == 9 ? "\n" : " ");
+    }
+
+    auto vec = input_fstream<int>(fname);
+    EXPECT_EQ(vec, expected);
+
+    std::remove(fname);
+}
+
+TEST(InputFstream, ReadsFromPipe)
+{
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+
+    // Larger than the pipe buffer, so the reader has to drain it while it is written
+    std::ostringstream text;
+    std::vector<int> expected(100000);
+
+    for (size_t i = 0; i < expected.size(); ++i)
+        expected[i] = static_cast<int>(i * 2654435761u);
+
+    text << expected.size() << "\n";
+    for (int v : expected) text << v << " ";
+
+    std::thread writer([&, content = text.str()]
+    {
+        std::vector<iovec> parts{{const_cast<char*>(content.data()), content.size()}};
+        writeAll(fds[1], parts);
+        ::close(fds[1]);
+    });
+
+    auto vec = input_fstream<int>("/dev/fd/" + std::to_string(fds[0]));
+    writer.join();
+    ::close(fds[0]);
+
+    EXPECT_EQ(vec, expected);
+}
+
+TEST(InputFstream, FifoIsNotProbedForMagic)
+{
+    const char* fname = "test_input_fifo_tmp";
+    std::remove(fname);
+    ASSERT_EQ(::mkfifo(fname, 0600), 0);
+
+    // Opening the FIFO to read its magic would block without a writer
+    EXPECT_FALSE(isBinaryFile(fname));
+    EXPECT_FALSE(isNpyFile(fname));
+
+    std::remove(fname);
+}
+
+TEST(InputFstream, ReportsHowManyNumbersWereReadBeforeBadToken)
+{
+    const char* fname = "test_input_bad_tmp.txt";
+    {
+        std::ofstream f(fname);
+        f << "4\n1 2 oops 4\n";
+    }
+
+    try {
+        input_fstream<int>(fname);
+        FAIL() << "Expected std::runtime_error";
+    } catch (const std::runtime_error& e) {
+        EXPECT_THAT(e.what(), HasSubstr("Expected: 4, got: 2"));
+    }
+
+    std::remove(fname);
+}
+
+TEST(WriteText, MatchesStreamOutputAcrossRounds)
+{
+    const char* fname = "test_output_text_tmp.txt";
+
+    std::vector<int> data(700000);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = static_cast<int>(i * 2654435761u);
+    data[0] = std::numeric_limits<int>::min();
+
+    std::ostringstream expected;
+    for (int v : data) expected << v << " ";
+    expected << '\n';
+
+    {
+        FILE* f = std::fopen(fname, "w");
+        writeText(fileno(f), data.data(), data.size());
+        std::fclose(f);
+    }
+
+    std::ifstream f(fname);
+    std::stringstream written;
+    written << f.rdbuf();
+
+    EXPECT_EQ(written.str(), expected.str());
+
+    std::remove(fname);
+}
+
+TEST(AsyncFileReader, ReadsBlocksInOrderWithAndWithoutIoUring)
+{
+    const char* fileName = "test_async_tmp.txt";
+
+    std::string content(3 * 4096 * 5 + 123, '\0');
+    std::mt19937 gen(7);
+
+    for (auto& c : content)
+        c = static_cast<char>(gen());
+
+    std::ofstream(fileName, std::ios::binary) << content;
+
+    for (bool tryIoUring : {true, false})
+    {
+        AsyncFileReader reader(std::string_view(fileName), 4096, 3, tryIoUring);
+
+        if (!tryIoUring) {
+            EXPECT_FALSE(reader.usesIoUring());
+        }
+
+        std::string read;
+
+        for (std::string_view block = reader.next(); !block.empty(); block = reader.next())
+            read.append(block);
+
+        EXPECT_EQ(read, content);
+    }
+
+    // A descriptor is read from its current position on
+    int fd = ::open(fileName, O_RDONLY);
+    ASSERT_GE(fd, 0);
+    ::lseek(fd, 1000, SEEK_SET);
+
+    {
+        AsyncReadBuf buffer(fd);
+        std::istream stream(&buffer);
+
+        EXPECT_EQ(std::string(std::istreambuf_iterator<char>(stream), {}), content.substr(1000));
+    }
+
+    ::close(fd);
+    std::remove(fileName);
+}
+
+TEST(DeltaFile, RoundTripsAndDecodesSingleBlocks)
+{
+    const char* fname = "test_output_tmp.dv";
+
+    std::vector<int> data(100000);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = static_cast<int>(i * 7 % 100003) - 50000;
+    data.push_back(std::numeric_limits<int>::min());
+    data.push_back(std::numeric_limits<int>::max());
+    std::sort(data.begin(), data.end());
+
+    writeDelta(fname, data.data(), data.size(), 1000);
+
+    DeltaReader reader(fname);
+    ASSERT_EQ(reader.count(), data.size());
+    EXPECT_EQ(reader.blocksCount(), 101u);
+    EXPECT_EQ(reader.decode<int>(), data);
+
+    std::vector<int> block(reader.blockSize());
+    ASSERT_EQ(reader.decodeBlock(100, block.data()), 2u);
+    EXPECT_EQ(block[1], std::numeric_limits<int>::max());
+
+    ASSERT_EQ(reader.decodeBlock(37, block.data()), 1000u);
+    EXPECT_TRUE(std::equal(block.begin(), block.end(), data.begin() + 37000));
+
+    EXPECT_LT(std::ifstream(fname, std::ios::ate | std::ios::binary).tellg(), 
+              static_cast<std::streamoff>(data.size() * sizeof(int) / 3));
+
+    std::remove(fname);
+}
+
 std::vector<int> generateRandomVec(size_t n, int min = -1000, int max = 1000)
 {
     std::vector<int> v(n);
@@ -166,8 +352,12 @@ TEST(BitonicSortModernized, SameResultAsClassic_OnSmallArray)
     EXPECT_EQ(data1, data2);
 }
 
-TEST(BitonicSort, ThrowsOnInvalidKernel)
+TEST(OddEvenMergeSort, SameResultAsStdSort)
 {
+    auto data = generateRandomVec(1024);
+    auto expected = data;
+    std::sort(expected.begin(), expected.end());
+
     auto searcher = createDeviceSearcher();
     cl::Device dev;
     try {
@@ -176,16 +366,950 @@ TEST(BitonicSort, ThrowsOnInvalidKernel)
         GTEST_SKIP();
     }
 
-    std::string badKernel = "__kernel void dummy() { python is the best language }";
+    std::string kernelSource = bs::readKernel("src/oddEvenMerge_gkernel.cl") + 
+                               bs::readKernel("src/oddEvenMerge_lkernel.cl");
 
-    std::vector<int> data(16, 0);
+    oddEvenMergeSort(data, dev, kernelSource);
 
-    EXPECT_THROW(
-        bitonicSort(data, dev, badKernel),
-        cl::Error
-    );
+    EXPECT_EQ(data, expected);
+}
+
+TEST(Network, ParsesKnownNamesAndThrowsOnUnknown)
+{
+    EXPECT_EQ(parseNetwork("bitonic"), Network::Bitonic);
+    EXPECT_EQ(parseNetwork("oddeven"), Network::OddEvenMerge);
+    EXPECT_THROW(parseNetwork("bubble"), std::invalid_argument);
+}
+
+TEST(RadixBucketSort, SortsUniformAndSkewedNonPowerOfTwo)
+{
+    auto searcher = createDeviceSearcher();
+    cl::Device dev;
+    try {
+        dev = searcher->getFirstSuitableDevice();
+    } catch (...) {
+        GTEST_SKIP();
+    }
+
+    std::string kernelSource = bs::readKernel("src/bitonicSort_gkernel.cl") + 
+                               bs::readKernel("src/bitonicSort_lkernel.cl") +
+                               bs::readKernel("src/radixBucket_kernel.cl");
+
+    auto uniform = generateRandomVec(3000, std::numeric_limits<int>::min(), std::numeric_limits<int>::max());
+    auto skewed = generateRandomVec(3000, -5, 5);
+    skewed.push_back(std::numeric_limits<int>::max());
+
+    // A dense cluster inside a wide range takes several refinement levels
+    auto clustered = generateRandomVec(2000, 0, 600);
+    auto spread = generateRandomVec(1000, std::numeric_limits<int>::min(), std::numeric_limits<int>::max());
+    clustered.insert(clustered.end(), spread.begin(), spread.end());
+
+    for (auto data : {uniform, skewed, clustered})
+    {
+        auto expected = data;
+        std::sort(expected.begin(), expected.end());
+
+        bs::sort(data, dev, kernelSource, SortConfig{Engine::RadixBucket});
+
+        EXPECT_EQ(data, expected);
+    }
+}
+
+TEST(BitonicSortTransposed, SameResultAsStdSort)
+{
+    auto data = generateRandomVec(4096);
+    auto expected = data;
+    std::sort(expected.begin(), expected.end());
+
+    auto searcher = createDeviceSearcher();
+    cl::Device dev;
+    try {
+        dev = searcher->getFirstSuitableDevice();
+    } catch (...) {
+        GTEST_SKIP();
+    }
+
+    std::string kernelSource = bs::readKernel("src/bitonicSort_gkernel.cl") + 
+                               bs::readKernel("src/bitonicSort_lkernel.cl") +
+                               bs::readKernel("src/bitonicTranspose_kernel.cl");
+
+    networkSort(data, dev, kernelSource, Network::Bitonic, true);
+
+    EXPECT_EQ(data, expected);
+}
+
+TEST(CpuBitonicSort, SameResultAsStdSort)
+{
+    auto searcher = createDeviceSearcher();
+    std::optional<cl::Device> cpu;
+
+    for (size_t p = 0; p < searcher->getPlatformsCount() && !cpu; ++p) {
+        for (size_t d = 0; d < searcher->getDevicesCount(p) && !cpu; ++d) {
+            cl::Device dd = searcher->getDevice(p, d);
+            if (isCpuDevice(dd)) cpu = dd;
+        }
+    }
+
+    if (!cpu) {
+        GTEST_SKIP() << "Нет OpenCL CPU устройства";
+    }
+
+    auto data = generateRandomVec(4096);
+    auto expected = data;
+    std::sort(expected.begin(), expected.end());
+
+    std::string kernelSource = bs::readKernel("src/bitonicSort_ckernel.cl");
+
+    cpuBitonicSort(data, *cpu, kernelSource);
+
+    EXPECT_EQ(data, expected);
+}
+
+TEST(WideIndex, ChosenOnlyPastIntMax)
+{
+    size_t intMax = std::numeric_limits<int>::max();
+
+    EXPECT_FALSE(needsWideIndex(intMax));
+    EXPECT_TRUE(needsWideIndex(intMax + 1));
+
+    EXPECT_EQ(indexBuildOptions(1024), "");
+    EXPECT_THAT(indexBuildOptions(size_t(3) << 30), HasSubstr("index_t=long"));
+}
+
+TEST(NpyFile, SortsEveryDtypeFromMappingIntoWriter)
+{
+    const char* inName = "test_input_tmp.npy";
+    const char* outName = "test_output_tmp.npy";
+
+    auto searcher = createDeviceSearcher();
+    cl::Device dev;
+    try {
+        dev = searcher->getFirstSuitableDevice();
+    } catch (...) {
+        GTEST_SKIP();
+    }
+
+    std::string kernelSource = bs::readKernel("src/bitonicSort_gkernel.cl") + 
+                               bs::readKernel("src/bitonicSort_lkernel.cl") +
+                               bs::readKernel("src/bitonicSort_ckernel.cl");
+
+    auto check = [&]<typename T>(std::type_identity<T>)
+    {
+        std::vector<T> data(1000);
+        std::mt19937 gen(42);
+        std::uniform_real_distribution<double> dist(std::is_signed_v<T> ? -1e6 : 0, 1e6);
+
+        for (auto& key : data)
+            key = static_cast<T>(dist(gen));
+
+        if constexpr (std::is_floating_point_v<T>)
+            data[7] = -std::numeric_limits<T>::infinity();
+
+        auto expected = data;
+        std::sort(expected.begin(), expected.end());
+
+        writeNpy(inName, data.data(), data.size());
+        ASSERT_TRUE(isNpyFile(inName));
+
+        NpyReader input(inName);
+        ASSERT_EQ(input.dtype(), npyDtypeOf<T>());
+        ASSERT_EQ(input.count(), data.size());
+
+        {
+            NpyWriter<T> output(outName, input.count());
+            bs::sort(input.keys<T>(), output.keys(), input.count(), dev, kernelSource, SortConfig{});
+        }
+
+        NpyReader sorted(outName);
+        EXPECT_EQ(std::vector<T>(sorted.keys<T>(), sorted.keys<T>() + sorted.count()), expected);
+    };
+
+    check(std::type_identity<int32_t>{});
+    check(std::type_identity<int64_t>{});
+    check(std::type_identity<uint32_t>{});
+    check(std::type_identity<float>{});
+
+    {
+        std::string header = makeNpyHeader(NpyDtype::Float64, 4);
+        header.replace(header.find("(4,),"), 5, "(2,2)");
+
+        std::ofstream(inName, std::ios::binary) << header << std::string(4 * sizeof(double), '\0');
+    }
+
+    EXPECT_THROW(NpyReader{inName}, std::runtime_error);
+
+    std::remove(inName);
+    std::remove(outName);
+}
+
+TEST(NpyFile, SortsInfinitiesAndRejectsNan)
+{
+    const char* inName = "test_input_tmp.npy";
+    const char* outName = "test_output_tmp.npy";
+
+    auto searcher = createDeviceSearcher();
+    cl::Device dev;
+    try {
+        dev = searcher->getFirstSuitableDevice();
+    } catch (...) {
+        GTEST_SKIP();
+    }
+
+    std::string kernelSource = bs::readKernel("src/bitonicSort_gkernel.cl") + 
+                               bs::readKernel("src/bitonicSort_lkernel.cl") +
+                               bs::readKernel("src/bitonicSort_ckernel.cl");
+
+    auto check = [&]<typename T>(std::type_identity<T>)
+    {
+        std::vector<T> data(3000);
+        std::mt19937 gen(42);
+        std::uniform_real_distribution<T> dist(-1e6, 1e6);
+
+        for (auto& key : data)
+            key = dist(gen);
+
+        // +inf keys are equal to the padding and must still all come back
+        for (size_t i = 0; i < 31; ++i)
+        {
+            data[i * 97] = std::numeric_limits<T>::infinity();
+            data[i * 97 + 1] = -std::numeric_limits<T>::infinity();
+        }
+
+        auto expected = data;
+        std::sort(expected.begin(), expected.end());
+
+        writeNpy(inName, data.data(), data.size());
+
+        {
+            NpyReader input(inName);
+            NpyWriter<T> output(outName, input.count());
+            bs::sort(input.keys<T>(), output.keys(), input.count(), dev, kernelSource, SortConfig{});
+        }
+
+        NpyReader sorted(outName);
+        EXPECT_EQ(std::vector<T>(sorted.keys<T>(), sorted.keys<T>() + sorted.count()), expected);
+
+        data[1234] = std::numeric_limits<T>::quiet_NaN();
+        writeNpy(inName, data.data(), data.size());
+
+        try {
+            NpyReader input(inName);
+            FAIL() << "Expected std::runtime_error";
+        } catch (const std::runtime_error& e) {
+            EXPECT_THAT(e.what(), HasSubstr("NaN at index 1234"));
+        }
+    };
+
+    check(std::type_identity<float>{});
+
+    if (dev.getInfo<CL_DEVICE_EXTENSIONS>().find("cl_khr_fp64") != std::string::npos)
+        check(std::type_identity<double>{});
+
+    std::remove(inName);
+    std::remove(outName);
+}
+
+TEST(BinaryFile, SortsStraightFromMappingIntoWriter)
+{
+    const char* inName = "test_input_tmp.bin";
+    const char* outName = "test_output_tmp.bin";
+
+    auto searcher = createDeviceSearcher();
+    cl::Device dev;
+    try {
+        dev = searcher->getFirstSuitableDevice();
+    } catch (...) {
+        GTEST_SKIP();
+    }
+
+    std::string kernelSource = bs::readKernel("src/bitonicSort_gkernel.cl") + 
+                               bs::readKernel("src/bitonicSort_lkernel.cl") +
+                               bs::readKernel("src/bitonicSort_ckernel.cl");
+
+    auto data = generateRandomVec(1000);
+    auto expected = data;
+    std::sort(expected.begin(), expected.end());
+
+    writeBinary(inName, data.data(), data.size(), false);
+    ASSERT_TRUE(isBinaryFile(inName));
+
+    {
+        BinaryReader input(inName);
+        EXPECT_FALSE(input.sorted());
+
+        BinaryWriter<int> output(outName, input.count());
+        bs::sort(input.keys<int>(), output.keys(), input.count(), dev, kernelSource, SortConfig{});
+        output.finish(true);
+    }
+
+    BinaryReader sorted(outName);
+    EXPECT_TRUE(sorted.sorted());
+    EXPECT_EQ(std::vector<int>(sorted.keys<int>(), sorted.keys<int>() + sorted.count()), expected);
+
+    {
+        std::fstream f(inName, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(sizeof(BinaryHeader));
+        f.put('\x7f');
+    }
+
+    EXPECT_THROW(BinaryReader{inName}, std::runtime_error);
+
+    std::remove(inName);
+    std::remove(outName);
 }
 
+TEST(StreamSort, MergesChunksWithAndWithoutCountHeader)
+{
+    auto searcher = createDeviceSearcher();
+    cl::Device dev;
+    try {
+        dev = searcher->getFirstSuitableDevice();
+    } catch (...) {
+        GTEST_SKIP();
+    }
+
+    std::string kernelSource = bs::readKernel("src/bitonicSort_gkernel.cl")  + 
+                               bs::readKernel("src/bitonicSort_lkernel.cl")  +
+                               bs::readKernel("src/bitonicSort_ckernel.cl")  +
+                               bs::readKernel("src/oddEvenMerge_gkernel.cl") +
+                               bs::readKernel("src/oddEvenMerge_lkernel.cl");
+
+    auto data = generateRandomVec(1300);
+    auto expected = data;
+    std::sort(expected.begin(), expected.end());
+
+    for (bool header : {true, false})
+    {
+        std::ostringstream text;
+        if (header) text << data.size() << "\n";
+        for (int v : data) text << v << " ";
+
+        std::stringbuf source(text.str());
+
+        EXPECT_EQ(streamSort<int>(&source, dev, kernelSource, SortConfig{}, header, 256), expected);
+    }
+
+    // Without a header a leading number equal to the count of the rest is a key
+    std::stringbuf headerless("3 5 1 2");
+    EXPECT_EQ(streamSort<int>(&headerless, dev, kernelSource, SortConfig{}, false, 256), (std::vector<int>{1, 2, 3, 5}));
+
+    std::stringbuf fewer("4 5 1 2");
+    EXPECT_THROW(streamSort<int>(&fewer, dev, kernelSource, SortConfig{}, true, 256), std::runtime_error);
+
+    std::stringbuf more("2 5 1 2");
+    EXPECT_THROW(streamSort<int>(&more, dev, kernelSource, SortConfig{}, true, 256), std::runtime_error);
+
+    std::ostringstream wideText;
+    std::vector<cl_long> wide(700);
+    for (size_t i = 0; i < wide.size(); ++i)
+        wide[i] = (static_cast<cl_long>(data[i]) << 33) + static_cast<cl_long>(i);
+
+    wideText << wide.size() << "\n";
+    for (cl_long v : wide) wideText << v << " ";
+
+    std::stringbuf wideSource(wideText.str());
+    std::sort(wide.begin(), wide.end());
+
+    EXPECT_EQ(streamSort<cl_long>(&wideSource, dev, kernelSource, SortConfig{}, true, 256), wide);
+}
+
+TEST(SortInBlocks, SortsMappedFileLargerThanTwoBlocks)
+{
+    const char* fname = "test_inplace_tmp.bin";
+
+    auto searcher = createDeviceSearcher();
+    cl::Device dev;
+    try {
+        dev = searcher->getFirstSuitableDevice();
+    } catch (...) {
+        GTEST_SKIP();
+    }
+
+    std::string kernelSource = bs::readKernel("src/bitonicSort_gkernel.cl")  + 
+                               bs::readKernel("src/bitonicSort_lkernel.cl")  +
+                               bs::readKernel("src/bitonicSort_ckernel.cl")  +
+                               bs::readKernel("src/oddEvenMerge_gkernel.cl") +
+                               bs::readKernel("src/oddEvenMerge_lkernel.cl");
+
+    for (size_t n : {1000u, 1024u, 1100u})
+    {
+        auto data = generateRandomVec(n);
+        data.back() = std::numeric_limits<int>::max();
+        auto expected = data;
+        std::sort(expected.begin(), expected.end());
+
+        writeBinary(fname, data.data(), data.size(), false);
+
+        {
+            BinaryReader file(fname, true, true);
+            sortInBlocks(file.mutableKeys<int>(), file.count(), dev, kernelSource, SortConfig{}, 128);
+            file.markSorted();
+        }
+
+        BinaryReader sorted(fname);
+        EXPECT_TRUE(sorted.sorted());
+        EXPECT_EQ(std::vector<int>(sorted.keys<int>(), sorted.keys<int>() + sorted.count()), expected) << n;
+    }
+
+    std::remove(fname);
+}
+
+TEST(ExternalSort, MergesSpilledRunsInSeveralPasses)
+{
+    auto searcher = createDeviceSearcher();
+    cl::Device dev;
+    try {
+        dev = searcher->getFirstSuitableDevice();
+    } catch (...) {
+        GTEST_SKIP();
+    }
+
+    std::string kernelSource = bs::readKernel("src/bitonicSort_gkernel.cl")  + 
+                               bs::readKernel("src/bitonicSort_lkernel.cl")  +
+                               bs::readKernel("src/bitonicSort_ckernel.cl")  +
+                               bs::readKernel("src/oddEvenMerge_gkernel.cl") +
+                               bs::readKernel("src/oddEvenMerge_lkernel.cl");
+
+    size_t budget = 32 << 10;
+    ExternalPlan plan = planExternalSort<int>(budget);
+    ASSERT_EQ(plan.fanIn, 3u);
+
+    auto data = generateRandomVec(plan.runKeys * 10 + 123, std::numeric_limits<int>::min(), std::numeric_limits<int>::max());
+    auto expected = data;
+    std::sort(expected.begin(), expected.end());
+
+    size_t consumed = 0;
+    auto source = [&](int* keys, size_t n) {
+        size_t taken = std::min(n, data.size() - consumed);
+        std::copy_n(data.data() + consumed, taken, keys);
+        consumed += taken;
+        return taken;
+    };
+
+    std::vector<int> sorted;
+    auto sink = [&](const int* keys, size_t n) { sorted.insert(sorted.end(), keys, keys + n); };
+
+    EXPECT_EQ(externalSort<int>(source, sink, dev, kernelSource, SortConfig{}, budget, std::filesystem::temp_directory_path()), 
+              data.size());
+    EXPECT_EQ(sorted, expected);
+}
+
+TEST(KeyColumn, GathersRowsInStableKeyOrder)
+{
+    auto searcher = createDeviceSearcher();
+    cl::Device dev;
+    try {
+        dev = searcher->getFirstSuitableDevice();
+    } catch (...) {
+        GTEST_SKIP();
+    }
+
+    std::string kernelSource = bs::readKernel("src/bitonicSort_gkernel.cl") + 
+                               bs::readKernel("src/bitonicSort_lkernel.cl") +
+                               bs::readKernel("src/bitonicSort_ckernel.cl");
+
+    std::string text = "a,3,x\nb,-1,y\n\nc,3,z\r\nd,-7,w";
+
+    KeyColumn column = parseKeyColumn(text, 1, ',');
+    ASSERT_EQ(column.keys, (std::vector<int32_t>{3, -1, 3, -7}));
+
+    std::vector<uint32_t> order = argsort(column.keys.data(), column.keys.size(), dev, kernelSource, SortConfig{});
+    EXPECT_EQ(order, (std::vector<uint32_t>{3, 1, 0, 2}));
+
+    FILE* out = std::tmpfile();
+    ASSERT_NE(out, nullptr);
+
+    writeRows(fileno(out), column, order.data(), order.size());
+
+    std::string written(64, '\0');
+    std::rewind(out);
+    written.resize(std::fread(written.data(), 1, written.size(), out));
+    std::fclose(out);
+
+    EXPECT_EQ(written, "d,-7,w\nb,-1,y\na,3,x\nc,3,z\r\n");
+
+    EXPECT_THROW(parseKeyColumn("a,1\nb\n", 1, ','), std::runtime_error);
+}
+
+TEST(MergeRuns, MergesSortedFilesThroughLoserTree)
+{
+    // Five sources: not a power of two, one empty and one with heavy duplicates
+    std::vector<std::vector<int>> shards = {
+        generateRandomVec(1000), {}, generateRandomVec(5000, -5, 5), {42}, generateRandomVec(7000)
+    };
+
+    std::vector<std::string> names;
+    std::vector<int> expected;
+
+    for (auto& shard : shards)
+    {
+        std::sort(shard.begin(), shard.end());
+        expected.insert(expected.end(), shard.begin(), shard.end());
+
+        names.push_back("test_merge_tmp" + std::to_string(names.size()) + ".bin");
+        writeBinary(names.back(), shard.data(), shard.size(), true);
+    }
+
+    std::sort(expected.begin(), expected.end());
+
+    std::vector<int> merged;
+    mergeRuns<int>(names, 1024, [&](const int* keys, size_t n) { merged.insert(merged.end(), keys, keys + n); });
+
+    EXPECT_EQ(merged, expected);
+
+    writeBinary(names[0], shards[0].data(), shards[0].size(), false);
+    EXPECT_THROW(mergeRuns<int>(names, 1024, [](const int*, size_t) {}), std::runtime_error);
+
+    for (const auto& name : names)
+        std::remove(name.c_str());
+}
+
+TEST(Profile, RecordsTransfersStagesAndBuild)
+{
+    auto searcher = createDeviceSearcher();
+    cl::Device dev;
+    try {
+        dev = searcher->getFirstSuitableDevice();
+    } catch (...) {
+        GTEST_SKIP();
+    }
+
+    std::string kernelSource = readKernel("src/bitonicSort_gkernel.cl") +
+                               readKernel("src/bitonicSort_lkernel.cl") +
+                               readKernel("src/bitonicSort_ckernel.cl");
+
+    std::vector<int> data = generateKeys(Distribution::Uniform, 3000, 1);
+    std::vector<int> expected = data;
+    std::sort(expected.begin(), expected.end());
+
+    Profile profile;
+    SortConfig config;
+    config.profile = &profile;
+
+    sort(data, dev, kernelSource, config);
+
+    EXPECT_EQ(data, expected);
+
+    size_t padded = 4096;
+    std::map<ProfileKind, size_t> launches;
+
+    for (const auto& record : profile.records())
+    {
+        ++launches[record.kind];
+        EXPECT_GE(Profile::seconds(record), 0);
+    }
+
+    size_t localLaunches = 0;
+    size_t globalLaunches = 0;
+
+    if (isCpuDevice(dev))
+    {
+        // One block sort, then every stage above the block runs one global
+        // launch per substage down to the block and one block merge
+        size_t blockStages = std::countr_zero(padded / cpuBlockSize<int>(dev, padded));
+
+        localLaunches = 1 + blockStages;
+
+        for (size_t stage = 1; stage <= blockStages; ++stage)
+            globalLaunches += stage;
+    }
+    else
+    {
+        // Every stage up to the work group runs one local launch, every stage
+        // above it one global launch per substage
+        size_t perItem = getNetworkSchedule(Network::Bitonic).elementsPerItem;
+        size_t tileStages = std::countr_zero(std::min(padded, dev.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>() * perItem));
+
+        localLaunches = tileStages;
+
+        for (size_t stage = tileStages + 1; stage <= 12; ++stage)
+            globalLaunches += stage;
+    }
+
+    EXPECT_EQ(launches[ProfileKind::Upload], 1u);
+    EXPECT_EQ(launches[ProfileKind::DeviceCopy], 1u);
+    EXPECT_EQ(launches[ProfileKind::Build], 1u);
+    EXPECT_EQ(launches[ProfileKind::Download], 1u);
+    EXPECT_EQ(launches[ProfileKind::LocalStage], localLaunches);
+    EXPECT_EQ(launches[ProfileKind::GlobalStage], globalLaunches);
+    EXPECT_GT(profile.deviceSpan(), 0);
+
+    std::ostringstream report;
+    profile.report(report);
+
+    EXPECT_NE(report.str().find("stage 2^12"), std::string::npos);
+    EXPECT_NE(report.str().find("transfers"), std::string::npos);
+
+    std::ostringstream trace;
+    profile.writeTrace(trace);
+
+    EXPECT_NE(trace.str().find("\"name\": \"program build\""), std::string::npos);
+    EXPECT_NE(trace.str().find("\"tid\": 1001"), std::string::npos);
+    EXPECT_EQ(trace.str().rfind("\n]}\n"), trace.str().size() - 4);
+
+    std::ostringstream roofline;
+    profile.roofline(roofline, 100e9);
+
+    EXPECT_NE(roofline.str().find("global substage 2^11: "), std::string::npos);
+    EXPECT_NE(roofline.str().find("% of peak"), std::string::npos);
+    EXPECT_EQ(roofline.str().find("upload"), std::string::npos);
+}
+
+TEST(Profile, RooflineRowsPerSubstageAgainstPeak)
+{
+    auto searcher = createDeviceSearcher();
+    cl::Device dev;
+    try {
+        dev = searcher->getFirstSuitableDevice();
+    } catch (...) {
+        GTEST_SKIP();
+    }
+
+    if (isCpuDevice(dev)) {
+        GTEST_SKIP() << "CPU devices run the block kernels, not the network substages";
+    }
+
+    std::string kernelSource = readKernel("src/bitonicSort_gkernel.cl") +
+                               readKernel("src/bitonicSort_lkernel.cl");
+
+    size_t n = 1 << 16;
+    size_t perItem = getNetworkSchedule(Network::Bitonic).elementsPerItem;
+    size_t tileStages = std::countr_zero(std::min(n, dev.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>() * perItem));
+
+    std::vector<int> data = generateKeys(Distribution::Uniform, n, 1);
+
+    Profile profile;
+    SortConfig config;
+    config.profile = &profile;
+
+    sort(data, dev, kernelSource, config);
+
+    // Every global launch reads and writes the whole buffer once
+    std::map<size_t, std::pair<size_t, double>> substages;
+
+    for (const auto& record : profile.records())
+    {
+        if (record.kind != ProfileKind::GlobalStage)
+            continue;
+
+        EXPECT_EQ(record.bytes, 2 * sizeof(int) * n);
+
+        auto& [bytes, seconds] = substages[std::countr_zero(record.subStage)];
+        bytes += record.bytes;
+        seconds += Profile::seconds(record);
+    }
+
+    const double peak = 1e9;
+
+    std::ostringstream roofline;
+    profile.roofline(roofline, peak);
+
+    EXPECT_EQ(roofline.str().find("upload"), std::string::npos);
+    EXPECT_EQ(roofline.str().find("readback"), std::string::npos);
+
+    // Substage 2^j runs in every stage above both the tile and j
+    size_t stages = std::countr_zero(n);
+
+    for (size_t j = 0; j < stages && tileStages < stages; ++j)
+    {
+        size_t launches = stages - std::max(tileStages, j);
+        auto [bytes, seconds] = substages[j];
+
+        ASSERT_EQ(bytes, launches * 2 * sizeof(int) * n);
+
+        if (seconds <= 0)
+            continue;
+
+        double bandwidth = bytes / seconds;
+
+        std::ostringstream line;
+        line << std::fixed << "global substage 2^" << j << ": " << std::setprecision(0) << 100 * bandwidth / peak
+             << "% of peak (" << std::setprecision(2) << bandwidth / 1e9 << " GB/s, " << launches
+             << (launches == 1 ? " launch)\n" : " launches)\n");
+
+        EXPECT_THAT(roofline.str(), HasSubstr(line.str()));
+    }
+}
+
+TEST(PeakBandwidth, CacheRoundTripsAndIsUsedInsteadOfMeasuring)
+{
+    auto searcher = createDeviceSearcher();
+    cl::Device dev;
+    try {
+        dev = searcher->getFirstSuitableDevice();
+    } catch (...) {
+        GTEST_SKIP();
+    }
+
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "biton_bandwidth_test";
+    std::filesystem::remove_all(dir);
+
+    std::filesystem::path path = dir / "biton" / "bandwidth";
+    std::string key = dev.getInfo<CL_DEVICE_NAME>() + " / " + dev.getInfo<CL_DRIVER_VERSION>();
+
+    appendBandwidthCache(path, "Some GPU / 1.2.3", 1.0 / 3 * 1e11);
+    appendBandwidthCache(path, key, 123456789012.5);
+
+    auto peaks = readBandwidthCache(path);
+
+    ASSERT_EQ(peaks.size(), 2u);
+    EXPECT_EQ(peaks["Some GPU / 1.2.3"], 1.0 / 3 * 1e11);
+    EXPECT_EQ(peaks[key], 123456789012.5);
+
+    // An empty kernel source could not measure, the cached peak is returned
+    const char* oldCache = std::getenv("XDG_CACHE_HOME");
+    std::string saved = oldCache ? oldCache : "";
+    ::setenv("XDG_CACHE_HOME", dir.c_str(), 1);
+
+    EXPECT_EQ(peakBandwidth(dev, ""), 123456789012.5);
+
+    if (oldCache)
+        ::setenv("XDG_CACHE_HOME", saved.c_str(), 1);
+    else
+        ::unsetenv("XDG_CACHE_HOME");
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST(BenchStats, SummarizesSamplesAndGeneratesSeededKeys)
+{
+    Timings timings = summarize({5, 1, 4, 2, 3});
+
+    EXPECT_DOUBLE_EQ(timings.median, 3);
+    EXPECT_DOUBLE_EQ(timings.p10, 1.4);
+    EXPECT_DOUBLE_EQ(timings.p90, 4.6);
+    EXPECT_DOUBLE_EQ(timings.mean, 3);
+    EXPECT_DOUBLE_EQ(timings.stddev, std::sqrt(2.5));
+    EXPECT_EQ(timings.samples, (std::vector<double>{5, 1, 4, 2, 3}));
+
+    EXPECT_EQ(generateKeys(Distribution::Uniform, 1000, 7), generateKeys(Distribution::Uniform, 1000, 7));
+    EXPECT_NE(generateKeys(Distribution::Uniform, 1000, 7), generateKeys(Distribution::Uniform, 1000, 8));
+
+    std::vector<int> sorted = generateKeys(Distribution::Sorted, 1000, 7);
+    std::vector<int> reverse = generateKeys(Distribution::Reverse, 1000, 7);
+    std::vector<int> nearly = generateKeys(Distribution::NearlySorted, 1000, 7);
+    std::vector<int> fewUnique = generateKeys(Distribution::FewUnique, 1000, 7);
+
+    EXPECT_TRUE(std::is_sorted(sorted.begin(), sorted.end()));
+    EXPECT_TRUE(std::is_sorted(reverse.rbegin(), reverse.rend()));
+    EXPECT_FALSE(std::is_sorted(nearly.begin(), nearly.end()));
+
+    std::sort(nearly.begin(), nearly.end());
+    EXPECT_EQ(nearly, sorted);
+
+    std::sort(fewUnique.begin(), fewUnique.end());
+    EXPECT_LE(std::unique(fewUnique.begin(), fewUnique.end()) - fewUnique.begin(), 16);
+
+    EXPECT_EQ(parseDistribution(distributionName(Distribution::NearlySorted)), Distribution::NearlySorted);
+    EXPECT_THROW(parseDistribution("gaussian"), std::invalid_argument);
+}
+
+TEST(BitonicSort, ThrowsOnInvalidKernel)
+{
+    auto searcher = createDeviceSearcher();
+    cl::Device dev;
+    try {
+        dev = searcher->getFirstSuitableDevice();
+    } catch (...) {
+        GTEST_SKIP();
+    }
+
+    std::string badKernel = "__kernel void dummy() { python is the best language }";
+
+    std::vector<int> data(16, 0);
+
+    EXPECT_THROW(
+        bitonicSort(data, dev, badKernel),
+        cl::Error
+    );
+}
+
+TEST(BenchStats, MannWhitneyFlagsOnlySeparatedSamples)
+{
+    std::vector<double> fast = {1.0, 1.1, 0.9, 1.05, 0.95};
+    std::vector<double> slow = {1.3, 1.4, 1.2, 1.35, 1.25};
+    std::vector<double> overlapping = {1.0, 1.3, 0.9, 1.2, 0.95};
+
+    // Every slow sample above every fast one: 1 of C(10, 5) orderings
+    EXPECT_NEAR(mannWhitneyGreater(slow, fast), 1.0 / 252, 1e-12);
+    EXPECT_NEAR(mannWhitneyGreater(fast, slow), 1.0, 1e-12);
+    EXPECT_GT(mannWhitneyGreater(overlapping, fast), 0.05);
+
+    // Large samples take the normal approximation
+    std::vector<double> shifted(50);
+    std::vector<double> base(50);
+
+    for (size_t i = 0; i < 50; ++i)
+    {
+        base[i] = 1.0 + 0.01 * (i % 10);
+        shifted[i] = base[i] + 0.05;
+    }
+
+    EXPECT_LT(mannWhitneyGreater(shifted, base), 0.001);
+    EXPECT_GT(mannWhitneyGreater(base, base), 0.4);
+}
+
+TEST(Workload, GeneratesAnyRangeOnItsOwn)
+{
+    const Distribution distributions[] = {
+        Distribution::Uniform, Distribution::Sorted, Distribution::Reverse, Distribution::NearlySorted,
+        Distribution::FewUnique, Distribution::Zipf, Distribution::AllEqual, Distribution::OrganPipe,
+        Distribution::Staggered,
+    };
+
+    size_t n = 5000;
+
+    for (Distribution distribution : distributions)
+    {
+        KeyGenerator generator(distribution, n, 3);
+        std::vector<int> whole(n);
+        std::vector<int> pieces(n);
+
+        generator(0, whole.data(), n);
+
+        for (size_t first = 0; first < n; first += 777)
+            generator(first, pieces.data() + first, std::min<size_t>(777, n - first));
+
+        EXPECT_EQ(pieces, whole) << distributionName(distribution);
+        EXPECT_EQ(parseDistribution(distributionName(distribution)), distribution);
+    }
+
+    std::vector<int> zipf = generateKeys(Distribution::Zipf, 100000, 3);
+    std::map<int, size_t> counts;
+
+    for (int key : zipf)
+        ++counts[key];
+
+    // The most frequent of 65536 ranks is drawn with probability 1 / H(65536)
+    size_t top = 0;
+
+    for (const auto& [key, count] : counts)
+        top = std::max(top, count);
+
+    EXPECT_NEAR(top / 100000.0, 0.085, 0.01);
+
+    std::vector<int> allEqual = generateKeys(Distribution::AllEqual, 100, 3);
+    EXPECT_EQ(std::count(allEqual.begin(), allEqual.end(), allEqual[0]), 100);
+
+    std::vector<int> organPipe = generateKeys(Distribution::OrganPipe, 1000, 3);
+    EXPECT_TRUE(std::is_sorted(organPipe.begin(), organPipe.begin() + 500));
+    EXPECT_TRUE(std::is_sorted(organPipe.rbegin(), organPipe.rbegin() + 500));
+
+    // Block 0 takes the second 1/64 of the range, block 32 the first
+    std::vector<int> staggered = generateKeys(Distribution::Staggered, 6400, 3);
+    EXPECT_GT(*std::min_element(staggered.begin(), staggered.begin() + 100),
+              *std::max_element(staggered.begin() + 3200, staggered.begin() + 3300));
+}
+
+TEST(StdSort, ParallelMatchesSerial)
+{
+    std::vector<int> serial = generateKeys(Distribution::FewUnique, 100000, 7);
+    std::vector<int> parallel = serial;
+
+    stdSort(serial);
+    stdSortParallel(parallel);
+
+    EXPECT_TRUE(std::is_sorted(serial.begin(), serial.end()));
+    EXPECT_EQ(parallel, serial);
+}
+
+TEST(Verify, DigestIgnoresOrderAndCatchesChangedKeys)
+{
+    auto searcher = createDeviceSearcher();
+    cl::Device dev;
+    try {
+        dev = searcher->getFirstSuitableDevice();
+    } catch (...) {
+        GTEST_SKIP();
+    }
+
+    std::string kernelSource = bs::readKernel("src/bitonicSort_gkernel.cl") +
+                               bs::readKernel("src/bitonicSort_lkernel.cl") +
+                               bs::readKernel("src/bitonicSort_ckernel.cl") +
+                               bs::readKernel("src/verify_kernel.cl");
+
+    cl::Context context(dev);
+    cl::CommandQueue queue(context, dev);
+    cl::Program program = buildProgram(context, dev, kernelSource, "");
+
+    auto digest = [&](std::vector<int> keys) {
+        cl::Buffer buffer(context, CL_MEM_READ_WRITE, sizeof(int) * keys.size());
+        queue.enqueueWriteBuffer(buffer, CL_TRUE, 0, sizeof(int) * keys.size(), keys.data());
+        return digestKeys<cl_int>(context, queue, program, dev, buffer, keys.size());
+    };
+
+    auto data = generateRandomVec(5000);
+    data.push_back(0);
+    auto sorted = data;
+    std::sort(sorted.begin(), sorted.end());
+
+    KeyDigest input = digest(data);
+    KeyDigest output = digest(sorted);
+
+    EXPECT_FALSE(input.sorted);
+    EXPECT_TRUE(output.sorted);
+    EXPECT_TRUE(input.sameKeys(output));
+    EXPECT_NO_THROW(checkDigests(input, output));
+
+    auto lost = sorted;
+    lost.front() -= 1;
+    EXPECT_THROW(checkDigests(input, digest(lost)), std::runtime_error);
+
+    auto swapped = sorted;
+    std::swap(swapped[10], swapped[4000]);
+    EXPECT_THROW(checkDigests(input, digest(swapped)), std::runtime_error);
+
+    SortConfig config;
+    config.verify = true;
+
+    bs::sort(data, dev, kernelSource, config);
+
+    EXPECT_EQ(data, sorted);
+}
+
+TEST(Counters, CountHotPathsOnlyWhenCompiledIn)
+{
+    auto searcher = createDeviceSearcher();
+    cl::Device dev;
+    try {
+        dev = searcher->getFirstSuitableDevice();
+    } catch (...) {
+        GTEST_SKIP();
+    }
+
+    std::string kernelSource = bs::readKernel("src/bitonicSort_gkernel.cl") +
+                               bs::readKernel("src/bitonicSort_lkernel.cl") +
+                               bs::readKernel("src/bitonicSort_ckernel.cl");
+
+    auto data = generateRandomVec(3000);
+
+    resetCounters();
+    bs::sort(data, dev, kernelSource, SortConfig{});
+
+    EXPECT_TRUE(std::is_sorted(data.begin(), data.end()));
+
+    if (!countersEnabled)
+    {
+        for (size_t i = 0; i < countersCount; ++i)
+            EXPECT_EQ(counterValue(static_cast<Counter>(i)), 0u);
+
+        return;
+    }
+
+    EXPECT_EQ(counterValue(Counter::ProgramBuilds), 1u);
+    EXPECT_EQ(counterValue(Counter::BufferAllocations), 1u);
+    EXPECT_EQ(counterValue(Counter::BufferBytes), sizeof(int) * 4096);
+    EXPECT_EQ(counterValue(Counter::UploadBytes), sizeof(int) * 3000);
+    EXPECT_EQ(counterValue(Counter::DownloadBytes), sizeof(int) * 3000);
+    EXPECT_EQ(counterValue(Counter::DeviceCopyBytes), sizeof(int) * 1096);
+    EXPECT_GT(counterValue(Counter::LocalLaunches) + counterValue(Counter::GlobalLaunches), 0u);
+
+    std::ostringstream report;
+    reportCounters(report);
+    EXPECT_THAT(report.str(), HasSubstr("program builds"));
+}
+
+
 int main(int argc, char **argv)
 {
     ::testing::InitGoogleTest(&argc, argv);